@@ -0,0 +1,145 @@
+#!/bin/sh
+#
+# End-to-end benchmark: plays one game per combination of team count,
+# players per team and board side, then prints one CSV row per game.
+#
+# Every knob is an environment variable (make passes its command line ones):
+#   TEAMS    team counts to try          (default "2 4", at most 9)
+#   PLAYERS  processes per team          (default "1 4")
+#   AGENTS   --agents per process        (default 1)
+#   SIZES    board sides                 (default "16 64")
+#   TICKS    steps per player, 0 = play until someone wins (default 200)
+#   LOCK     global, striped or lockfree (default global)
+#   PLAN     1 for the team planner, 0 for --no-plan (default 1)
+#   SEED     --seed for every process    (default 42)
+#   TIMEOUT  seconds before a game is interrupted (default 60)
+#   LEMIPC   binary to time (default ./lemipc_bench, the -O2 build without
+#            sanitizers that make bench builds first)
+#
+# Columns: moves_per_sec is over the wall time of the whole game, ticks is
+# the most steps any player took, latencies cover the steps that moved, and
+# completed is 0 when the timeout had to stop the game.
+
+LEMIPC=${LEMIPC:-./lemipc_bench}
+TEAMS=${TEAMS:-"2 4"}
+PLAYERS=${PLAYERS:-"1 4"}
+AGENTS=${AGENTS:-1}
+SIZES=${SIZES:-"16 64"}
+TICKS=${TICKS:-200}
+LOCK=${LOCK:-global}
+PLAN=${PLAN:-1}
+SEED=${SEED:-42}
+TIMEOUT=${TIMEOUT:-60}
+
+case "$LOCK" in
+    global) LOCK_FLAG= ;;
+    striped) LOCK_FLAG=--striped ;;
+    lockfree) LOCK_FLAG=--lockfree ;;
+    *) echo "bench.sh: unknown LOCK '$LOCK'" >&2; exit 1 ;;
+esac
+
+PLAN_FLAG=
+if [ "$PLAN" -eq 0 ]; then
+    PLAN_FLAG=--no-plan
+fi
+
+TICKS_FLAG=
+if [ "$TICKS" -gt 0 ]; then
+    TICKS_FLAG="--ticks $TICKS"
+fi
+
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"; "$LEMIPC" --clean >/dev/null 2>&1' EXIT
+
+now_ns() {
+    date +%s%N
+}
+
+echo "teams,players,agents,width,height,lock,plan,processes,moves,steps,ticks,wall_ms,moves_per_sec,p50_us,p99_us,cpu_ms,completed"
+
+for teams in $TEAMS; do
+    if [ "$teams" -lt 2 ] || [ "$teams" -gt 9 ]; then
+        echo "bench.sh: skipping $teams teams, valid counts are 2-9" >&2
+        continue
+    fi
+    for players in $PLAYERS; do
+        for size in $SIZES; do
+            "$LEMIPC" --clean >/dev/null 2>&1
+            rm -f "$TMP"/*
+
+            start=$(now_ns)
+            for t in $(seq 1 "$teams"); do
+                for p in $(seq 1 "$players"); do
+                    (
+                        timeout -s INT "$TIMEOUT" "$LEMIPC" --bench --quiet --seed "$SEED" \
+                            --width "$size" --height "$size" --agents "$AGENTS" \
+                            $LOCK_FLAG $PLAN_FLAG $TICKS_FLAG "$t" >"$TMP/$t.$p.log" 2>&1
+                        echo $? >"$TMP/$t.$p.status"
+                    ) &
+                done
+            done
+            wait
+            end=$(now_ns)
+
+            completed=1
+            if grep -qx 124 "$TMP"/*.status; then
+                completed=0
+            fi
+
+            cat "$TMP"/*.log | grep '^BENCH ' | awk \
+                -v teams="$teams" -v players="$players" -v agents="$AGENTS" \
+                -v size="$size" -v lock="$LOCK" -v plan="$PLAN" -v completed="$completed" \
+                -v wall_ns=$((end - start)) '
+            {
+                for (i = 2; i <= NF; i++) {
+                    split($i, kv, "=")
+                    f[kv[1]] = kv[2]
+                }
+                processes++
+                moves += f["moves"]
+                steps += f["steps"]
+                cpu += f["cpu_ms"]
+                if (f["ticks"] > ticks)
+                    ticks = f["ticks"]
+                n = split(f["hist"], pairs, ",")
+                for (i = 1; i <= n; i++) {
+                    split(pairs[i], vc, ":")
+                    hist[vc[1] + 0] += vc[2]
+                    total += vc[2]
+                }
+            }
+            function percentile(q,    rank, seen, k, m, sorted) {
+                if (total == 0)
+                    return 0
+                m = 0
+                for (k in hist)
+                    sorted[++m] = k + 0
+                # insertion sort, there are a few dozen buckets at most
+                for (i = 2; i <= m; i++) {
+                    v = sorted[i]
+                    for (j = i - 1; j > 0 && sorted[j] > v; j--)
+                        sorted[j + 1] = sorted[j]
+                    sorted[j + 1] = v
+                }
+                rank = int(q * total)
+                if (rank >= total)
+                    rank = total - 1
+                seen = 0
+                for (i = 1; i <= m; i++) {
+                    seen += hist[sorted[i]]
+                    if (seen > rank)
+                        return sorted[i] / 1000
+                }
+                return sorted[m] / 1000
+            }
+            END {
+                wall_ms = wall_ns / 1e6
+                printf "%d,%d,%d,%d,%d,%s,%d,%d,%d,%d,%d,%.3f,%.1f,%.3f,%.3f,%.3f,%d\n",
+                    teams, players, agents, size, size, lock, plan, processes,
+                    moves, steps, ticks, wall_ms,
+                    (wall_ms > 0 ? moves * 1000 / wall_ms : 0),
+                    percentile(0.50), percentile(0.99), cpu, completed
+            }'
+        done
+    done
+done
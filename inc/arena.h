@@ -0,0 +1,60 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHM_ARENA_KEY 0xf000
+#define ARENA_NAME "lemipc.arena"
+#define ARENA_MAGIC 0x494d454c /* "LEMI" */
+#define ARENA_VERSION 10
+
+#define CACHE_LINE 64
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE)))
+
+/*
+ * Everything the players share lives in a single mapping: this header,
+ * then each section at the cache line aligned offset recorded here. The
+ * layout only depends on the board size, so a joiner can check the one it
+ * attached against the one it computes.
+ */
+struct arena
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    int width;
+    int height;
+    int backend;
+    int hugepages;
+    /* Tells this game from any earlier one, for --record. */
+    uint64_t game_id;
+    uint64_t game_offset;
+    uint64_t roster_offset;
+    uint64_t stats_offset;
+    uint64_t rings_offset;
+    uint64_t broadcasts_offset;
+    uint64_t matrix_offset;
+    uint64_t owners_offset;
+    uint64_t spatial_offset;
+    uint64_t planes_offset;
+} CACHE_ALIGNED;
+
+extern struct arena *arena;
+
+#define ARENA_SECTION(type, section) ((type *)((char *)arena + arena->section##_offset))
+
+/*
+ * Joins the running game, or creates the arena for board_width x
+ * board_height under shm_backend. Must be called with the semaphore held.
+ */
+void arena_attach();
+/* Read only view for the observer and --stats; 0 if no game is running. */
+int arena_attach_read_only();
+/* Whether a mapping of that size holds an arena of this version. */
+int arena_layout_is_valid(const struct arena *a, size_t mapped);
+void arena_detach();
+/* Destroys the arena; processes still attached keep their mapping. */
+int arena_remove();
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+/*
+ * Per process counters for --bench. Every step is timed, moves go into a
+ * latency histogram, and bench_report() prints a single BENCH line that
+ * bench.sh collects from all the processes of a run.
+ */
+void bench_begin(int players);
+void bench_step(int state, uint64_t start_ns, int steps);
+void bench_report(int team);
+
+#endif
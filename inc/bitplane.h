@@ -0,0 +1,26 @@
+#ifndef BITPLANE_H
+#define BITPLANE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * One bit per cell for every team, plus an occupied plane (plane 0, as
+ * team 0 never shows on the board). Kept in sync with the matrix by the same
+ * hook as the piece counters; the matrix stays the source of truth for
+ * claims, the planes are what full board scans read.
+ */
+size_t bitplane_size(int width, int height);
+void bitplane_attach(uint64_t *planes);
+void bitplane_reset();
+/*
+ * Makes the bits of the cell agree with value, what the matrix holds there
+ * now: team's bit, value's bit and the occupied bit.
+ */
+void bitplane_sync(int row, int col, int team, int value);
+
+int bitplane_count(int team);
+int bitplane_find_free(int *row, int *col);
+int bitplane_find_surrounded(int *row, int *col, int *team);
+
+#endif
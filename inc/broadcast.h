@@ -0,0 +1,55 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <stdint.h>
+#include <arena.h>
+#include <globals.h>
+
+#define BROADCAST_SLOTS 64
+#define BROADCAST_TEXT 116
+#define BROADCAST_SUBSCRIBERS MAX_PROCESSES
+
+/*
+ * Per team multicast log in the arena. A broadcast is written once, at the
+ * position taken from head, and every subscriber walks the log with its own
+ * cursor. A slot is only reused once all subscribed cursors went past it, so
+ * publishing costs the same whatever the number of readers.
+ *
+ * Zero filled is an empty log: entry p is stored with seq p + 1 and a
+ * cursor with pos + 1, 0 meaning nobody holds that subscription.
+ */
+struct broadcast_entry
+{
+    uint64_t seq;
+    int32_t len;
+    char text[BROADCAST_TEXT];
+} CACHE_ALIGNED;
+
+struct broadcast_cursor
+{
+    uint64_t pos;
+} CACHE_ALIGNED;
+
+struct broadcast_log
+{
+    uint64_t head CACHE_ALIGNED;
+    /* Every cursor was at or past this when it was last computed. */
+    uint64_t low_water CACHE_ALIGNED;
+    struct broadcast_cursor cursors[BROADCAST_SUBSCRIBERS];
+    struct broadcast_entry entries[BROADCAST_SLOTS];
+};
+
+/* -1 when a subscriber is still BROADCAST_SLOTS entries behind. */
+int broadcast_publish(struct broadcast_log *log, const char *text);
+/* Starts reading at the next broadcast; -1 if every subscription is taken. */
+int broadcast_subscribe(struct broadcast_log *log);
+void broadcast_unsubscribe(struct broadcast_log *log, int sub);
+/*
+ * Next unread broadcast of a subscriber, read in place, or NULL. Broadcasts
+ * it fell too far behind to see are skipped and added to *lost.
+ */
+const struct broadcast_entry *broadcast_next(struct broadcast_log *log, int sub, uint64_t *lost);
+/* Moves past the entry; -1 if it was overwritten while being read. */
+int broadcast_done(struct broadcast_log *log, int sub, const struct broadcast_entry *entry);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+#define CHECKPOINT_MAGIC 0x50414e53494d454cULL /* "LEMISNAP" */
+#define CHECKPOINT_VERSION 1
+#define DEFAULT_CHECKPOINT_SECONDS 10
+
+/*
+ * A checkpoint file is this header followed by an image of the whole
+ * arena, taken while no player was in the middle of a board change. It is
+ * written to a temporary file renamed over the old one, so a crash while
+ * writing leaves the previous checkpoint intact.
+ */
+struct checkpoint_header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t arena_version;
+    uint64_t arena_size;
+    int64_t taken_at;
+    uint32_t epoch;
+    uint32_t reserved[7];
+};
+
+/*
+ * Writes checkpoint_path if one was given and the board could be copied
+ * consistently. 1 when written, -1 when skipped.
+ */
+int checkpoint_write();
+/* Periodic checkpoints and those asked for with SIGUSR1 (checkpoint_request). */
+void checkpoint_if_due();
+void checkpoint_request(int sig);
+
+/*
+ * Resuming, for the process creating the arena: checkpoint_resume_board()
+ * maps resume_path and sets the board size from it, checkpoint_resume()
+ * then copies it into the new arena. Every player of the checkpoint is
+ * left as an orphan slot for the next player of its team to adopt.
+ */
+void checkpoint_resume_board();
+void checkpoint_resume();
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <stdint.h>
+
+/*
+ * Shared (non private) futexes, so the word may live in a segment mapped by
+ * several processes. timeout_ms < 0 waits forever.
+ */
+int futex_wait(uint32_t *addr, uint32_t expected, int timeout_ms);
+int futex_wake(uint32_t *addr, int count);
+
+/*
+ * Same, but a wake only reaches the waiters whose bitset shares a bit with
+ * the waker's, so several waiters can sleep on one word and be woken apart.
+ */
+int futex_wait_bitset(uint32_t *addr, uint32_t expected, uint32_t bitset, int timeout_ms);
+int futex_wake_bitset(uint32_t *addr, int count, uint32_t bitset);
+
+#endif
@@ -3,12 +3,31 @@
 
 #define MAX_TEAMS 10
 #define MAX_PROCESSES 100
-#define WIDTH 5
-#define HEIGHT 5
+#define DEFAULT_WIDTH 5
+#define DEFAULT_HEIGHT 5
+#define MAX_BOARD_SIDE 4096
+#define DEFAULT_FPS 20
+#define MAX_AGENTS 1000000
+#define MAX_AGENT_THREADS 256
 
-extern int shm_id;
 extern int sem_id;
 extern int *shm_ptr;
-extern int msg_ids[MAX_TEAMS];
+extern int board_width;
+extern int board_height;
+extern int render_board;
+extern int verify_captures;
+extern int agent_threads;
+extern int seed_given;
+extern unsigned int game_seed;
+extern int bench_mode;
+extern int max_ticks;
+extern int team_planning;
+extern int shm_backend;
+extern int use_hugepages;
+extern char backing_dir[];
+extern const char *record_path;
+extern const char *checkpoint_path;
+extern const char *resume_path;
+extern int checkpoint_seconds;
 
 #endif // GLOBALS_H
@@ -0,0 +1,25 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * Log-linear latency histogram in nanoseconds: exact below 16ns, then eight
+ * buckets per power of two, so any recorded value is off by 12.5% at most.
+ * Recording is a relaxed atomic add, safe from several threads at once.
+ */
+#define HIST_BUCKETS 496
+
+struct histogram
+{
+    uint64_t counts[HIST_BUCKETS];
+};
+
+uint64_t monotonic_ns();
+void hist_record(struct histogram *h, uint64_t ns);
+uint64_t hist_total(const struct histogram *h);
+uint64_t hist_bucket_value(int bucket);
+/* Value below which a fraction q of the samples fall, 0 when empty. */
+uint64_t hist_percentile(const struct histogram *h, double q);
+
+#endif
@@ -1,10 +1,94 @@
 #ifndef LEM_IPC_H
 #define LEM_IPC_H
 
-void play_game(int team);
-void cleanup_shared_matrix();
-void restore_player_position();
+#include <stdint.h>
+#include <globals.h>
+#include <rng.h>
+#include <arena.h>
+#include <locks.h>
+
+#define SEM_KEY 0x5678
+#define ROSTER_WORDS ((MAX_PROCESSES + 63) / 64)
+
+/*
+ * Game section of the arena. Words written on every move get their own
+ * cache lines, so they neither bounce with each other nor with the fields
+ * every player keeps reading.
+ */
+struct game_state
+{
+    int current_team;
+    int current_player_pid;
+    int lock_mode;
+
+    struct ticket_lock global_lock;
+
+    /* Turn order, see turns.c. */
+    int turn_cursor[MAX_TEAMS] CACHE_ALIGNED;
+    uint32_t turn_wake[MAX_TEAMS][MAX_PROCESSES] CACHE_ALIGNED;
+
+    int processes CACHE_ALIGNED;
+
+    int game_started CACHE_ALIGNED;
+
+    uint32_t epoch CACHE_ALIGNED;
+    uint32_t epoch_waiters;
+    uint32_t board_writers;
+
+    int team_pieces[MAX_TEAMS] CACHE_ALIGNED;
+    int active_teams;
+
+    /* Board epoch of the last plan of each team, see planner.c. */
+    uint32_t plan_epoch[MAX_TEAMS] CACHE_ALIGNED;
+
+    /*
+     * Roster slots in use, one bit each, and the broadcast subscription of
+     * every slot, so a dead player's can be given back. reap_at is the
+     * monotonic time of the next liveness check. Orphans are slots of a
+     * resumed checkpoint, in use but with no process yet, see checkpoint.h.
+     */
+    uint64_t roster_used[MAX_TEAMS][ROSTER_WORDS] CACHE_ALIGNED;
+    uint64_t roster_orphan[MAX_TEAMS][ROSTER_WORDS];
+    int roster_sub[MAX_TEAMS][MAX_PROCESSES];
+    uint64_t reap_at;
+};
+
+#define PLAYER_WAITING 0
+#define PLAYER_MOVED 1
+#define PLAYER_DONE 2
+
+/* A piece on the board: the process itself, or one of its agents. */
+struct player
+{
+    int team;
+    int id;
+    int position[2];
+    uint32_t seen_epoch;
+    int steps;
+    struct rng rng;
+
+    /* Flank cell given by the team planner, while goal_ttl > 0. */
+    int goal[2];
+    int target[2];
+    int target_team;
+    int goal_ttl;
+    uint32_t plan_seen;
+};
+
+void play_game(int team, int agents);
+int player_step(struct player *p);
+void wait_for_turn(int state, uint32_t seen);
+uint32_t board_epoch();
+void run_agents(struct player *players, int count, int threads);
+void restore_players();
+void unregister_player();
+void reap_dead_players();
+int player_is_dead(int pid);
+int team_subscription();
 void cleanup();
-void detach_matrix();
+void broadcast_message(int team, const char *message);
+void receive_broadcasts();
+void print_matrix(const int *cells);
+void observe(int fps);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,76 @@
+#ifndef LOCKS_H
+#define LOCKS_H
+
+#include <stdint.h>
+#include <arena.h>
+
+#define LOCK_GLOBAL 0
+#define LOCK_STRIPED 1
+#define LOCK_FREE 2
+
+extern int lock_mode;
+
+/* Tickets whose owner is remembered; more waiters than this is unheard of. */
+#define TICKET_OWNERS 1024
+
+/*
+ * FIFO lock living in the arena: take a ticket from next, then wait until
+ * serving reaches it. Waiters spin a little when they are next in line and
+ * sleep on serving otherwise, each on the futex bit of its own ticket, so
+ * a release wakes only the ticket it serves.
+ *
+ * owners[ticket % TICKET_OWNERS] holds the ticket in its high half and the
+ * pid that took it in the low one. Sleeps are timed, so a waiter notices
+ * when the ticket being served belongs to a dead process, held or still
+ * queued, and serves the next one in its place.
+ */
+struct ticket_lock
+{
+    uint32_t next CACHE_ALIGNED;
+    uint32_t serving CACHE_ALIGNED;
+    uint32_t sleepers;
+    uint64_t owners[TICKET_OWNERS] CACHE_ALIGNED;
+};
+
+/*
+ * Every acquire names its call site (LOCK_SITE_* in stats.h): the wait goes
+ * into that site's histogram, and the hold is charged to it on release.
+ *
+ * The semaphore only guards joining and leaving, which create and destroy
+ * the arena; once in it, players use the global ticket lock.
+ */
+void lock_semaphore(int site);
+void unlock_semaphore();
+void locks_attach(struct ticket_lock *global);
+void lock_global(int site);
+void unlock_global();
+/*
+ * Releases whichever global lock the calling thread holds, or is queued for:
+ * a ticket taken but not served yet is waited for and given back at once.
+ * Tiles it holds in striped mode are given back too.
+ */
+void unlock_if_held();
+
+/*
+ * Charges the rest of the current global hold to another site, returning
+ * the previous one so the caller can switch back. No-op without the lock.
+ */
+int lock_phase(int site);
+
+/* Per tick board access: only the global mode takes the ticket lock here. */
+void lock_board(int site);
+void unlock_board();
+
+/* Tiles covering the two cells (a move's source and destination). */
+void lock_cells(int site, int row1, int col1, int row2, int col2);
+void unlock_cells(int row1, int col1, int row2, int col2);
+
+/* Tiles covering the 3x3 neighbourhood of a cell (capture checks). */
+void lock_area(int site, int row, int col);
+void unlock_area(int row, int col);
+
+/* first: this process just created the arena. */
+void init_stripes(int first);
+void remove_stripes();
+
+#endif
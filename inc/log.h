@@ -0,0 +1,37 @@
+#ifndef LOG_H
+#define LOG_H
+
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+
+#define LOG_ARGS 6
+
+extern int log_level;
+
+/*
+ * Game events are not printed where they happen, often with a lock held:
+ * the format and its int arguments go as a binary record into a per
+ * process ring, and a drainer thread prints them. A full ring drops
+ * records instead of ever making a player wait.
+ */
+void log_start();
+/* Prints what is left and stops the drainer; later records print at once. */
+void log_stop();
+void log_write(int level, const char *fmt, int argc, const int *argv);
+/* -1 for an unknown name. */
+int log_parse_level(const char *name);
+
+/* Arguments are ints only, at most LOG_ARGS of them. */
+#define LOG(level, fmt, ...)                                                            \
+    do                                                                                  \
+    {                                                                                   \
+        if ((level) >= log_level)                                                       \
+        {                                                                               \
+            const int log_args_[] = {0, ##__VA_ARGS__};                                 \
+            log_write((level), (fmt), sizeof(log_args_) / sizeof(int) - 1, log_args_ + 1); \
+        }                                                                               \
+    } while (0)
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <lem_ipc.h>
+
+void planner_attach(struct game_state *game, int *matrix);
+/* Takes a plan read from the team broadcasts: 1 if text was one, 0 if not. */
+int planner_receive(const char *text);
+/*
+ * Returns 1 and the flank cell p should head for, or -1 when it has no
+ * assignment and just chases the nearest enemy.
+ */
+int planner_goal(struct player *p, int *goal_row, int *goal_col);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <arena.h>
+
+#define RING_SLOTS 128
+#define RING_TEXT 112
+
+/*
+ * Bounded multi-producer multi-consumer queue living in the arena, one per
+ * team. Each slot carries a sequence number: seq == pos means free for the
+ * producer at pos, seq == pos + 1 means filled for the consumer at pos.
+ * Producers and consumers only race on their own index with one CAS, so
+ * no call ever enters the kernel.
+ */
+struct ring_slot
+{
+    uint64_t seq;
+    int32_t type;
+    int32_t len;
+    char text[RING_TEXT];
+} CACHE_ALIGNED;
+
+struct ring
+{
+    uint64_t head CACHE_ALIGNED;
+    uint64_t tail CACHE_ALIGNED;
+    struct ring_slot slots[RING_SLOTS];
+};
+
+void ring_init(struct ring *ring);
+/* Copies text (truncated to RING_TEXT - 1) in; -1 when the ring is full. */
+int ring_send(struct ring *ring, int type, const char *text);
+/*
+ * Claims the oldest message if type is 0 or matches it, NULL otherwise.
+ * The slot stays valid, and is not reused, until ring_release().
+ */
+struct ring_slot *ring_receive(struct ring *ring, int type, uint64_t *pos);
+void ring_release(struct ring_slot *slot, uint64_t pos);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/* xorshift64* state; one per player, so no locking and no shared sequence. */
+struct rng
+{
+    uint64_t state;
+};
+
+void rng_seed(struct rng *rng, uint64_t seed, int team, int slot, int id);
+uint64_t rng_next(struct rng *rng);
+uint32_t rng_below(struct rng *rng, uint32_t bound);
+
+#endif
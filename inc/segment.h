@@ -0,0 +1,45 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define BACKEND_SYSV 0
+#define BACKEND_POSIX 1
+#define BACKEND_FILE 2
+
+#define BACKING_DIR_MAX 256
+#define HUGEPAGE_SIZE (2UL * 1024 * 1024)
+#define DEFAULT_BACKING_DIR "/var/tmp"
+
+/*
+ * A shared mapping that lives either in a SysV segment (key), a POSIX shm
+ * object (/name) or a file (dir/name), picked by shm_backend. With
+ * use_hugepages the size is rounded to whole huge pages: SysV asks for
+ * SHM_HUGETLB, the others advise transparent huge pages, and a file in a
+ * hugetlbfs mount gets them anyway.
+ */
+struct segment
+{
+    int backend;
+    int id;
+    void *addr;
+    size_t size;
+};
+
+/* Creates a zeroed mapping that must not exist yet; NULL if it does. */
+void *segment_create(struct segment *seg, key_t key, const char *name, size_t size);
+/* Maps an existing mapping at its current size; NULL if there is none. */
+void *segment_open(struct segment *seg, key_t key, const char *name, int read_only);
+/* Looks for an existing mapping under every backend and adopts its backend. */
+int segment_find(key_t key, const char *name);
+void segment_use_hugepages(struct segment *seg);
+/* Processes attached to a SysV segment, -1 for the backends that do not count. */
+int segment_attach_count(struct segment *seg);
+void segment_detach(struct segment *seg);
+/* Destroys the mapping under the current backend; attached ones stay valid. */
+int segment_remove(key_t key, const char *name);
+const char *backend_name(int backend);
+int parse_backend(const char *s);
+
+#endif
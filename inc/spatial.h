@@ -0,0 +1,20 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include <stddef.h>
+
+/*
+ * Per team piece counts for square buckets of the board, stored in shared
+ * memory right after the matrix and kept up to date by every claim/release.
+ */
+size_t spatial_index_size(int width, int height);
+void spatial_attach(int *matrix, int *index);
+void spatial_reset();
+void spatial_add(int row, int col, int team, int delta);
+
+/* Returns 1 and the closest enemy cell (Manhattan), -1 if there is none. */
+int spatial_nearest_enemy(int row, int col, int team, int *target_row, int *target_col);
+/* Same for the pieces of team itself, leaving out the one at skip. */
+int spatial_nearest_ally(int row, int col, int team, int skip_row, int skip_col, int *ally_row, int *ally_col);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <histogram.h>
+
+/* Where a lock was taken, or which phase of a hold is being charged. */
+#define LOCK_SITE_JOIN 0
+#define LOCK_SITE_PLACEMENT 1
+#define LOCK_SITE_MOVE 2
+#define LOCK_SITE_CAPTURE 3
+#define LOCK_SITE_RENDER 4
+#define LOCK_SITE_CLEANUP 5
+/* Not a lock: waiting for and holding the turn, see turns.h. */
+#define LOCK_SITE_TURN 6
+#define LOCK_SITE_CHECKPOINT 7
+#define LOCK_SITES 8
+
+/*
+ * Lock wait and hold times of every process, kept in their own section of
+ * the arena so `lemipc --stats` can read them while the game runs.
+ */
+struct lock_stats
+{
+    struct histogram wait[LOCK_SITES];
+    struct histogram hold[LOCK_SITES];
+};
+
+/* Where to record from now on; NULL stops recording. */
+void stats_attach(struct lock_stats *shared);
+void stats_wait(int site, uint64_t ns);
+void stats_hold(int site, uint64_t ns);
+
+/* Prints the histograms once, or every second until the game ends. */
+void show_stats(int watch);
+
+#endif
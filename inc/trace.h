@@ -0,0 +1,75 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC 0x45434152544d454cULL /* "LEMTRACE" */
+#define TRACE_VERSION 3
+/* Most events a trace file can hold, 24 bytes each. */
+#define TRACE_EVENTS (1 << 26)
+/* Events a thread reserves at once, so recording rarely touches the header. */
+#define TRACE_CHUNK 256
+/* Events the file grows by when recording reaches its end. */
+#define TRACE_GROW (1 << 16)
+
+#define TRACE_NONE 0
+#define TRACE_JOIN 1
+#define TRACE_MOVE 2
+#define TRACE_CAPTURE 3
+#define TRACE_LEAVE 4
+
+/*
+ * A --record file: this header, then fixed size events of the game whose
+ * arena carries game_id. Every process of it maps room for TRACE_EVENTS
+ * and threads claim TRACE_CHUNK slots at a time with one add on next, so
+ * events land in the file out of order and the replayer sorts them by
+ * time. The file only holds allocated events; whoever claims past them
+ * grows it by TRACE_GROW. A slot whose type is still TRACE_NONE was never
+ * written (the rest of a chunk, or a player killed mid-event).
+ */
+struct trace_header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t event_size;
+    uint32_t width;
+    uint32_t height;
+    uint64_t capacity;
+    uint64_t next;
+    uint64_t allocated;
+    uint64_t dropped;
+    uint64_t game_id;
+    /* monotonic_ns() when the game started recording; event times count from it. */
+    uint64_t start_ns;
+};
+
+/*
+ * row and col are the cell the event is about: where a piece joined, was
+ * captured or left, or where a move started, with to_row and to_col its
+ * destination. other is the captured team.
+ */
+struct trace_event
+{
+    uint64_t ns;
+    int32_t pid;
+    uint8_t type;
+    uint8_t team;
+    uint8_t other;
+    uint8_t pad;
+    uint16_t row;
+    uint16_t col;
+    uint16_t to_row;
+    uint16_t to_col;
+};
+
+/*
+ * Maps path for recording the game game_id, replacing a trace of another
+ * game. -1 if path is not a trace or cannot be mapped.
+ */
+int trace_open(const char *path, uint64_t game_id);
+void trace_close();
+void trace_record(int type, int team, int other, int row, int col, int to_row, int to_col);
+/* Re-simulates a trace and prints what happened; --render draws it at fps events/s. */
+void trace_replay(const char *path, int fps);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef TURNS_H
+#define TURNS_H
+
+/*
+ * With the global lock only one player touches the board at a time anyway,
+ * so instead of racing for the semaphore the processes take turns: the
+ * token goes team by team, and within a team from one roster slot to the
+ * next. In the other lock modes these calls do nothing.
+ */
+void turns_attach(int team, int slot);
+int turns_enabled();
+/* Blocks until this process holds the turn. */
+void turn_acquire();
+/* Hands the turn to the next process, waking only that one. */
+void turn_pass();
+/* Gives the turn away for good; the roster slot must already be cleared. */
+void turn_leave();
+/* Passes the turn on for a dead player of team, if it held it. */
+void turn_forfeit(int pid, int team);
+
+#endif
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <ft_malloc.h>
+#include <globals.h>
+#include <lem_ipc.h>
+#include <log.h>
+
+/*
+ * Agents are stepped in rounds: every live agent makes one decide-and-move
+ * step per round, then the pool waits for the board to change (or a tick),
+ * like a single player would between two moves.
+ *
+ * Each worker owns a slice of the round's task array as a deque: it pops
+ * from its own tail and, once empty, steals from the head of the others.
+ * Agents still alive after their step are appended to the next round's
+ * array, which gets cut into fresh slices at the round barrier.
+ */
+struct worker
+{
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+    pthread_t thread;
+};
+
+static struct worker *workers = NULL;
+static int worker_count = 0;
+static struct player **tasks = NULL;
+static struct player **next_tasks = NULL;
+static int next_count = 0;
+static int round_moved = 0;
+static int running = 1;
+static pthread_barrier_t round_barrier;
+static volatile sig_atomic_t stop_agents = 0;
+
+static void handle_agents_sigint(int sig)
+{
+    (void)sig;
+    stop_agents = 1;
+}
+
+static void split_round(int count)
+{
+    for (int i = 0; i < worker_count; i++)
+    {
+        workers[i].head = (int)((long)count * i / worker_count);
+        workers[i].tail = (int)((long)count * (i + 1) / worker_count);
+    }
+}
+
+static struct player *pop_own(struct worker *w)
+{
+    struct player *p = NULL;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->head < w->tail)
+        p = tasks[--w->tail];
+    pthread_mutex_unlock(&w->lock);
+    return p;
+}
+
+static struct player *steal(struct worker *self)
+{
+    int me = self - workers;
+
+    for (int i = 1; i < worker_count; i++)
+    {
+        struct worker *victim = &workers[(me + i) % worker_count];
+        struct player *p = NULL;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail)
+            p = tasks[victim->head++];
+        pthread_mutex_unlock(&victim->lock);
+        if (p != NULL)
+            return p;
+    }
+    return NULL;
+}
+
+/* Runs on one thread only, between the two round barriers. */
+static void end_round()
+{
+    int count = __atomic_load_n(&next_count, __ATOMIC_ACQUIRE);
+    struct player **swap = tasks;
+
+    if (count == 0 || stop_agents)
+    {
+        running = 0;
+        return;
+    }
+
+    tasks = next_tasks;
+    next_tasks = swap;
+    next_count = 0;
+    split_round(count);
+
+    wait_for_turn(round_moved ? PLAYER_MOVED : PLAYER_WAITING, board_epoch());
+    round_moved = 0;
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+
+    while (1)
+    {
+        struct player *p;
+
+        while ((p = pop_own(w)) != NULL || (p = steal(w)) != NULL)
+        {
+            int state = player_step(p);
+
+            if (state == PLAYER_MOVED)
+                __atomic_store_n(&round_moved, 1, __ATOMIC_RELAXED);
+            if (state != PLAYER_DONE)
+                next_tasks[__atomic_fetch_add(&next_count, 1, __ATOMIC_ACQ_REL)] = p;
+        }
+
+        if (pthread_barrier_wait(&round_barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+            end_round();
+        pthread_barrier_wait(&round_barrier);
+
+        if (!running)
+            break;
+    }
+    return NULL;
+}
+
+void run_agents(struct player *players, int count, int threads)
+{
+    sigset_t block;
+    sigset_t old;
+
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+    if (threads > count)
+        threads = count;
+
+    worker_count = threads;
+    workers = malloc(worker_count * sizeof(struct worker));
+    tasks = malloc(count * sizeof(struct player *));
+    next_tasks = malloc(count * sizeof(struct player *));
+    for (int i = 0; i < count; i++)
+        tasks[i] = &players[i];
+    split_round(count);
+    pthread_barrier_init(&round_barrier, NULL, worker_count);
+
+    LOG(LOG_INFO, "Running %d agents on %d threads.\n", count, worker_count);
+
+    /* Only this thread takes SIGINT; workers finish their round and stop. */
+    signal(SIGINT, handle_agents_sigint);
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    for (int i = 0; i < worker_count; i++)
+    {
+        pthread_mutex_init(&workers[i].lock, NULL);
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0)
+        {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        pthread_mutex_destroy(&workers[i].lock);
+    }
+
+    pthread_barrier_destroy(&round_barrier);
+    free(tasks);
+    free(next_tasks);
+    free(workers);
+}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <globals.h>
+#include <lem_ipc.h>
+#include <locks.h>
+#include <stats.h>
+#include <spatial.h>
+#include <bitplane.h>
+#include <segment.h>
+#include <ring.h>
+#include <broadcast.h>
+#include <arena.h>
+#include <log.h>
+#include <checkpoint.h>
+
+struct arena *arena = NULL;
+static struct segment arena_segment;
+
+static uint64_t add_section(uint64_t *offset, size_t size)
+{
+    uint64_t start = *offset;
+
+    *offset = (start + size + CACHE_LINE - 1) & ~(uint64_t)(CACHE_LINE - 1);
+    return start;
+}
+
+static void compute_layout(struct arena *layout, int width, int height)
+{
+    uint64_t offset = sizeof(struct arena);
+
+    memset(layout, 0, sizeof(*layout));
+    layout->magic = ARENA_MAGIC;
+    layout->version = ARENA_VERSION;
+    layout->width = width;
+    layout->height = height;
+    layout->game_offset = add_section(&offset, sizeof(struct game_state));
+    layout->roster_offset = add_section(&offset, MAX_TEAMS * MAX_PROCESSES * sizeof(int));
+    layout->stats_offset = add_section(&offset, sizeof(struct lock_stats));
+    layout->rings_offset = add_section(&offset, MAX_TEAMS * sizeof(struct ring));
+    layout->broadcasts_offset = add_section(&offset, MAX_TEAMS * sizeof(struct broadcast_log));
+    layout->matrix_offset = add_section(&offset, (size_t)width * height * sizeof(int));
+    layout->owners_offset = add_section(&offset, (size_t)width * height * sizeof(int));
+    layout->spatial_offset = add_section(&offset, spatial_index_size(width, height));
+    layout->planes_offset = add_section(&offset, bitplane_size(width, height));
+    layout->size = offset;
+}
+
+/* A mapping is only trusted once its header matches the layout it claims. */
+int arena_layout_is_valid(const struct arena *a, size_t mapped)
+{
+    struct arena expected;
+
+    if (mapped < sizeof(struct arena) || a->magic != ARENA_MAGIC || a->version != ARENA_VERSION)
+        return 0;
+    if (a->width < 1 || a->width > MAX_BOARD_SIDE || a->height < 1 || a->height > MAX_BOARD_SIDE)
+        return 0;
+    compute_layout(&expected, a->width, a->height);
+    return a->size == expected.size && a->size <= mapped &&
+           a->game_offset == expected.game_offset && a->roster_offset == expected.roster_offset &&
+           a->stats_offset == expected.stats_offset && a->rings_offset == expected.rings_offset &&
+           a->broadcasts_offset == expected.broadcasts_offset &&
+           a->matrix_offset == expected.matrix_offset && a->owners_offset == expected.owners_offset &&
+           a->spatial_offset == expected.spatial_offset && a->planes_offset == expected.planes_offset;
+}
+
+static int join_arena()
+{
+    int requested = shm_backend;
+
+    if (segment_find(SHM_ARENA_KEY, ARENA_NAME) == -1)
+        return 0;
+
+    /* SysV also tells a crashed game apart: nobody but us is attached. */
+    arena = segment_open(&arena_segment, SHM_ARENA_KEY, ARENA_NAME, 0);
+    if (arena != NULL && arena_layout_is_valid(arena, arena_segment.size) &&
+        ARENA_SECTION(struct game_state, game)->processes > 0 && segment_attach_count(&arena_segment) != 1)
+    {
+        /* Whoever joins later plays on the board the first process created. */
+        if (arena->width != board_width || arena->height != board_height)
+        {
+            LOG(LOG_INFO, "Joining existing %dx%d board.\n", arena->width, arena->height);
+            board_width = arena->width;
+            board_height = arena->height;
+        }
+        lock_mode = ARENA_SECTION(struct game_state, game)->lock_mode;
+        if (resume_path != NULL)
+            LOG(LOG_WARN, "A game is running: joining it instead of resuming.\n");
+        use_hugepages = arena->hugepages;
+        segment_use_hugepages(&arena_segment);
+        init_stripes(0);
+        return 1;
+    }
+
+    if (arena != NULL && arena->magic == ARENA_MAGIC && arena->version != ARENA_VERSION &&
+        arena_segment.size >= sizeof(struct arena))
+    {
+        fprintf(stderr, "A game with arena version %u is running (this is %u).\n", arena->version, ARENA_VERSION);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Left behind by a game that died: nobody is playing on it. */
+    if (log_level <= LOG_WARN)
+        printf("Removing stale arena (%s).\n", backend_name(shm_backend));
+    arena_detach();
+    arena_remove();
+    shm_backend = requested;
+    return 0;
+}
+
+void arena_attach()
+{
+    struct arena layout;
+
+    if (join_arena())
+        return;
+
+    if (resume_path != NULL)
+        checkpoint_resume_board();
+    compute_layout(&layout, board_width, board_height);
+    layout.backend = shm_backend;
+    layout.hugepages = use_hugepages;
+    layout.game_id = ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid();
+
+    arena = segment_create(&arena_segment, SHM_ARENA_KEY, ARENA_NAME, layout.size);
+    if (arena == NULL)
+    {
+        fprintf(stderr, "Shared arena appeared while creating it.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* The mapping is zero filled, a fresh game for every section but the rings. */
+    memcpy(arena, &layout, sizeof(layout));
+    ARENA_SECTION(struct game_state, game)->lock_mode = lock_mode;
+    for (int i = 0; i < MAX_TEAMS; i++)
+        ring_init(ARENA_SECTION(struct ring, rings) + i);
+    if (resume_path != NULL)
+        checkpoint_resume();
+    /* In the same semaphore hold, so nobody can join before the tiles exist. */
+    init_stripes(1);
+    if (log_level <= LOG_INFO)
+        printf("Shared arena initialized (%s%s, Size: %zu bytes).\n", backend_name(shm_backend),
+               use_hugepages ? ", huge pages" : "", arena_segment.size);
+}
+
+int arena_attach_read_only()
+{
+    if (segment_find(SHM_ARENA_KEY, ARENA_NAME) == -1)
+        return 0;
+    arena = segment_open(&arena_segment, SHM_ARENA_KEY, ARENA_NAME, 1);
+    if (arena == NULL)
+        return 0;
+    if (!arena_layout_is_valid(arena, arena_segment.size))
+    {
+        arena_detach();
+        return 0;
+    }
+    return 1;
+}
+
+void arena_detach()
+{
+    segment_detach(&arena_segment);
+    arena = NULL;
+}
+
+int arena_remove()
+{
+    return segment_remove(SHM_ARENA_KEY, ARENA_NAME);
+}
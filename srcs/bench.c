@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <globals.h>
+#include <lem_ipc.h>
+#include <histogram.h>
+#include <bench.h>
+
+static struct histogram move_latency;
+static uint64_t moves = 0;
+static uint64_t steps_total = 0;
+static int max_steps = 0;
+static int bench_players = 0;
+static uint64_t started_ns = 0;
+static int reported = 0;
+
+void bench_begin(int players)
+{
+    bench_players = players;
+    started_ns = monotonic_ns();
+}
+
+void bench_step(int state, uint64_t start_ns, int steps)
+{
+    int seen = __atomic_load_n(&max_steps, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&steps_total, 1, __ATOMIC_RELAXED);
+    if (state == PLAYER_MOVED)
+    {
+        hist_record(&move_latency, monotonic_ns() - start_ns);
+        __atomic_fetch_add(&moves, 1, __ATOMIC_RELAXED);
+    }
+    while (steps > seen && !__atomic_compare_exchange_n(&max_steps, &seen, steps, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static double timeval_ms(struct timeval tv)
+{
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/*
+ * One line of key=value pairs. The histogram goes out as lower-bound:count
+ * pairs so the driver can merge every process before taking percentiles.
+ */
+void bench_report(int team)
+{
+    struct rusage usage;
+
+    if (!bench_mode || started_ns == 0 || reported)
+        return;
+    reported = 1;
+
+    getrusage(RUSAGE_SELF, &usage);
+    printf("BENCH pid=%d team=%d players=%d moves=%llu steps=%llu ticks=%d elapsed_ms=%.3f cpu_ms=%.3f p50_us=%.3f p99_us=%.3f hist=",
+           getpid(), team, bench_players,
+           (unsigned long long)moves, (unsigned long long)steps_total, max_steps,
+           (monotonic_ns() - started_ns) / 1e6,
+           timeval_ms(usage.ru_utime) + timeval_ms(usage.ru_stime),
+           hist_percentile(&move_latency, 0.50) / 1e3,
+           hist_percentile(&move_latency, 0.99) / 1e3);
+    for (int i = 0, first = 1; i < HIST_BUCKETS; i++)
+    {
+        if (move_latency.counts[i] == 0)
+            continue;
+        printf("%s%llu:%llu", first ? "" : ",",
+               (unsigned long long)hist_bucket_value(i), (unsigned long long)move_latency.counts[i]);
+        first = 0;
+    }
+    printf("\n");
+    fflush(stdout);
+}
@@ -0,0 +1,308 @@
+#include <string.h>
+
+#include <globals.h>
+#include <bitplane.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define HAVE_AVX2_KERNELS
+#endif
+
+#define OCCUPIED 0
+
+/*
+ * Every plane has a zero row above and below the board, and every row a zero
+ * word on each side of its data words, which are rounded up to a multiple of
+ * four. Neighbour lookups never need bounds checks and the AVX2 kernels can
+ * load at word - 1 and word + 1 freely.
+ */
+static uint64_t *planes = NULL;
+static int row_words;
+static int stride;
+static size_t plane_words;
+
+static void compute_layout(int width, int height)
+{
+    row_words = (width + 63) / 64;
+    stride = ((row_words + 3) & ~3) + 2;
+    plane_words = (size_t)(height + 2) * stride;
+}
+
+size_t bitplane_size(int width, int height)
+{
+    compute_layout(width, height);
+    return plane_words * MAX_TEAMS * sizeof(uint64_t);
+}
+
+void bitplane_attach(uint64_t *shared_planes)
+{
+    compute_layout(board_width, board_height);
+    planes = shared_planes;
+}
+
+void bitplane_reset()
+{
+    memset(planes, 0, bitplane_size(board_width, board_height));
+}
+
+/* First data word of a row; row -1 and row board_height are padding. */
+static uint64_t *row_ptr(int plane, int row)
+{
+    return planes + plane * plane_words + (size_t)(row + 1) * stride + 1;
+}
+
+static void put_bit(int plane, int row, int col, int on)
+{
+    uint64_t bit = 1ULL << (col & 63);
+
+    if (on)
+        __atomic_fetch_or(&row_ptr(plane, row)[col >> 6], bit, __ATOMIC_SEQ_CST);
+    else
+        __atomic_fetch_and(&row_ptr(plane, row)[col >> 6], ~bit, __ATOMIC_SEQ_CST);
+}
+
+void bitplane_sync(int row, int col, int team, int value)
+{
+    put_bit(team, row, col, value == team);
+    if (value != 0 && value != team)
+        put_bit(value, row, col, 1);
+    put_bit(OCCUPIED, row, col, value != 0);
+}
+
+int bitplane_count(int team)
+{
+    int count = 0;
+
+    for (int r = 0; r < board_height; r++)
+    {
+        const uint64_t *words = row_ptr(team, r);
+        for (int w = 0; w < row_words; w++)
+            count += __builtin_popcountll(words[w]);
+    }
+    return count;
+}
+
+/* Bits past the right edge of the board are never set; treat them as taken. */
+static uint64_t valid_bits(int w)
+{
+    int rest = board_width - w * 64;
+    return rest >= 64 ? ~0ULL : (1ULL << rest) - 1;
+}
+
+static int find_free_in_word(int row, int w, uint64_t word, int *out_row, int *out_col)
+{
+    uint64_t free_bits = ~word & valid_bits(w);
+
+    if (free_bits == 0)
+        return -1;
+    *out_row = row;
+    *out_col = w * 64 + __builtin_ctzll(free_bits);
+    return 1;
+}
+
+/*
+ * Pieces of each team sitting on both sides of a cell, along any of the four
+ * lines is_piece_surrounded() looks at: horizontal, vertical and diagonals.
+ */
+static uint64_t pair_mask(const uint64_t *up, const uint64_t *mid, const uint64_t *down)
+{
+    uint64_t left = (mid[0] << 1) | (mid[-1] >> 63);
+    uint64_t right = (mid[0] >> 1) | (mid[1] << 63);
+    uint64_t up_left = (up[0] << 1) | (up[-1] >> 63);
+    uint64_t up_right = (up[0] >> 1) | (up[1] << 63);
+    uint64_t down_left = (down[0] << 1) | (down[-1] >> 63);
+    uint64_t down_right = (down[0] >> 1) | (down[1] << 63);
+
+    return (left & right) | (up[0] & down[0]) | (up_left & down_right) | (up_right & down_left);
+}
+
+/*
+ * Pieces of any team with two pieces of one other team around them. *team is
+ * set to the owner of the lowest such bit.
+ */
+static uint64_t surrounded_word(int row, int w, int *team)
+{
+    uint64_t pairs[MAX_TEAMS];
+    uint64_t all = 0;
+    uint64_t lowest = 0;
+
+    for (int t = 1; t < MAX_TEAMS; t++)
+        pairs[t] = pair_mask(row_ptr(t, row - 1) + w, row_ptr(t, row) + w, row_ptr(t, row + 1) + w);
+
+    for (int t = 1; t < MAX_TEAMS; t++)
+    {
+        uint64_t enemies = 0;
+        for (int e = 1; e < MAX_TEAMS; e++)
+        {
+            if (e != t)
+                enemies |= pairs[e];
+        }
+
+        uint64_t hit = row_ptr(t, row)[w] & enemies;
+        if (hit && (lowest == 0 || (hit & -hit) < lowest))
+        {
+            lowest = hit & -hit;
+            *team = t;
+        }
+        all |= hit;
+    }
+    return all;
+}
+
+static int find_free_scalar(int *row, int *col)
+{
+    for (int r = 0; r < board_height; r++)
+    {
+        const uint64_t *words = row_ptr(OCCUPIED, r);
+        for (int w = 0; w < row_words; w++)
+        {
+            if (find_free_in_word(r, w, words[w], row, col) == 1)
+                return 1;
+        }
+    }
+    return -1;
+}
+
+static int find_surrounded_scalar(int *row, int *col, int *team)
+{
+    for (int r = 0; r < board_height; r++)
+    {
+        for (int w = 0; w < row_words; w++)
+        {
+            uint64_t hit = surrounded_word(r, w, team);
+            if (hit)
+            {
+                *row = r;
+                *col = w * 64 + __builtin_ctzll(hit);
+                return 1;
+            }
+        }
+    }
+    return -1;
+}
+
+#ifdef HAVE_AVX2_KERNELS
+
+/* Four occupied words per compare; only the row tail goes through scalar code. */
+__attribute__((target("avx2")))
+static int find_free_avx2(int *row, int *col)
+{
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    int full_words = board_width / 64;
+
+    for (int r = 0; r < board_height; r++)
+    {
+        const uint64_t *words = row_ptr(OCCUPIED, r);
+        int w = 0;
+
+        for (; w + 4 <= full_words; w += 4)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(words + w));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(v, ones)) != -1)
+                break;
+        }
+        for (; w < row_words; w++)
+        {
+            if (find_free_in_word(r, w, words[w], row, col) == 1)
+                return 1;
+        }
+    }
+    return -1;
+}
+
+__attribute__((target("avx2")))
+static __m256i pair_mask_avx2(const uint64_t *up, const uint64_t *mid, const uint64_t *down)
+{
+    __m256i m = _mm256_loadu_si256((const __m256i *)mid);
+    __m256i u = _mm256_loadu_si256((const __m256i *)up);
+    __m256i d = _mm256_loadu_si256((const __m256i *)down);
+
+#define SHIFT_IN_LEFT(p, v) _mm256_or_si256(_mm256_slli_epi64(v, 1), _mm256_srli_epi64(_mm256_loadu_si256((const __m256i *)((p) - 1)), 63))
+#define SHIFT_IN_RIGHT(p, v) _mm256_or_si256(_mm256_srli_epi64(v, 1), _mm256_slli_epi64(_mm256_loadu_si256((const __m256i *)((p) + 1)), 63))
+    __m256i horizontal = _mm256_and_si256(SHIFT_IN_LEFT(mid, m), SHIFT_IN_RIGHT(mid, m));
+    __m256i vertical = _mm256_and_si256(u, d);
+    __m256i diagonal = _mm256_and_si256(SHIFT_IN_LEFT(up, u), SHIFT_IN_RIGHT(down, d));
+    __m256i anti_diagonal = _mm256_and_si256(SHIFT_IN_RIGHT(up, u), SHIFT_IN_LEFT(down, d));
+#undef SHIFT_IN_LEFT
+#undef SHIFT_IN_RIGHT
+
+    return _mm256_or_si256(_mm256_or_si256(horizontal, vertical), _mm256_or_si256(diagonal, anti_diagonal));
+}
+
+/*
+ * 256 cells of every plane per step. A hit only tells which four words to
+ * look at; the scalar kernel then reports the exact cell and team.
+ */
+__attribute__((target("avx2")))
+static int find_surrounded_avx2(int *row, int *col, int *team)
+{
+    for (int r = 0; r < board_height; r++)
+    {
+        for (int w = 0; w < row_words; w += 4)
+        {
+            __m256i pairs[MAX_TEAMS];
+            __m256i hits = _mm256_setzero_si256();
+
+            for (int t = 1; t < MAX_TEAMS; t++)
+                pairs[t] = pair_mask_avx2(row_ptr(t, r - 1) + w, row_ptr(t, r) + w, row_ptr(t, r + 1) + w);
+
+            for (int t = 1; t < MAX_TEAMS; t++)
+            {
+                __m256i enemies = _mm256_setzero_si256();
+                for (int e = 1; e < MAX_TEAMS; e++)
+                {
+                    if (e != t)
+                        enemies = _mm256_or_si256(enemies, pairs[e]);
+                }
+                __m256i mine = _mm256_loadu_si256((const __m256i *)(row_ptr(t, r) + w));
+                hits = _mm256_or_si256(hits, _mm256_and_si256(mine, enemies));
+            }
+
+            if (_mm256_testz_si256(hits, hits))
+                continue;
+
+            for (int i = w; i < w + 4 && i < row_words; i++)
+            {
+                uint64_t hit = surrounded_word(r, i, team);
+                if (hit)
+                {
+                    *row = r;
+                    *col = i * 64 + __builtin_ctzll(hit);
+                    return 1;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+static int have_avx2()
+{
+    static int supported = -1;
+
+    if (supported == -1)
+        supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return supported;
+}
+
+#endif
+
+/* First free cell in row major order, or -1 when the board is full. */
+int bitplane_find_free(int *row, int *col)
+{
+#ifdef HAVE_AVX2_KERNELS
+    if (have_avx2())
+        return find_free_avx2(row, col);
+#endif
+    return find_free_scalar(row, col);
+}
+
+/* First piece (row major) is_piece_surrounded() would report, or -1 if none. */
+int bitplane_find_surrounded(int *row, int *col, int *team)
+{
+#ifdef HAVE_AVX2_KERNELS
+    if (have_avx2())
+        return find_surrounded_avx2(row, col, team);
+#endif
+    return find_surrounded_scalar(row, col, team);
+}
@@ -0,0 +1,99 @@
+#include <string.h>
+
+#include <broadcast.h>
+
+/* Smallest position some subscriber still has to read, head if none. */
+static uint64_t lowest_cursor(struct broadcast_log *log, uint64_t head)
+{
+    uint64_t lowest = head;
+
+    for (int i = 0; i < BROADCAST_SUBSCRIBERS; i++)
+    {
+        uint64_t pos = __atomic_load_n(&log->cursors[i].pos, __ATOMIC_ACQUIRE);
+
+        if (pos != 0 && pos - 1 < lowest)
+            lowest = pos - 1;
+    }
+    return lowest;
+}
+
+int broadcast_publish(struct broadcast_log *log, const char *text)
+{
+    uint64_t pos = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+
+    do
+    {
+        /* Cursors are only scanned once per lap of the log, not per publish. */
+        if (pos - __atomic_load_n(&log->low_water, __ATOMIC_ACQUIRE) >= BROADCAST_SLOTS)
+        {
+            uint64_t lowest = lowest_cursor(log, pos);
+
+            __atomic_store_n(&log->low_water, lowest, __ATOMIC_RELEASE);
+            if (pos - lowest >= BROADCAST_SLOTS)
+                return -1;
+        }
+    } while (!__atomic_compare_exchange_n(&log->head, &pos, pos + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    struct broadcast_entry *entry = &log->entries[pos % BROADCAST_SLOTS];
+    size_t len = strnlen(text, BROADCAST_TEXT - 1);
+
+    /* Readers that lost the race with this lap see seq change under them. */
+    __atomic_store_n(&entry->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(entry->text, text, len);
+    entry->text[len] = '\0';
+    entry->len = (int32_t)len;
+    __atomic_store_n(&entry->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int broadcast_subscribe(struct broadcast_log *log)
+{
+    for (int i = 0; i < BROADCAST_SUBSCRIBERS; i++)
+    {
+        uint64_t free_slot = 0;
+        uint64_t start = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE) + 1;
+
+        if (__atomic_compare_exchange_n(&log->cursors[i].pos, &free_slot, start, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            return i;
+    }
+    return -1;
+}
+
+void broadcast_unsubscribe(struct broadcast_log *log, int sub)
+{
+    __atomic_store_n(&log->cursors[sub].pos, 0, __ATOMIC_RELEASE);
+}
+
+const struct broadcast_entry *broadcast_next(struct broadcast_log *log, int sub, uint64_t *lost)
+{
+    uint64_t cursor = __atomic_load_n(&log->cursors[sub].pos, __ATOMIC_RELAXED) - 1;
+    const struct broadcast_entry *entry = &log->entries[cursor % BROADCAST_SLOTS];
+    uint64_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+
+    if (seq == cursor + 1)
+        return entry;
+    if (seq <= cursor + 1)
+        return NULL;
+
+    /*
+     * Lapped: we subscribed while a publisher was computing the low water
+     * mark without us. Skip to the oldest broadcast that is still there.
+     */
+    uint64_t head = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+    uint64_t oldest = head > BROADCAST_SLOTS ? head - BROADCAST_SLOTS + 1 : 0;
+
+    *lost += oldest - cursor;
+    __atomic_store_n(&log->cursors[sub].pos, oldest + 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int broadcast_done(struct broadcast_log *log, int sub, const struct broadcast_entry *entry)
+{
+    uint64_t cursor = __atomic_load_n(&log->cursors[sub].pos, __ATOMIC_RELAXED) - 1;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    int intact = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == cursor + 1;
+    __atomic_store_n(&log->cursors[sub].pos, cursor + 2, __ATOMIC_RELEASE);
+    return intact ? 0 : -1;
+}
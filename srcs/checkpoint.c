@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <globals.h>
+#include <lem_ipc.h>
+#include <locks.h>
+#include <stats.h>
+#include <ring.h>
+#include <broadcast.h>
+#include <histogram.h>
+#include <arena.h>
+#include <log.h>
+#include <checkpoint.h>
+
+/* Tries at copying the arena between two board changes before giving up. */
+#define CHECKPOINT_RETRIES 64
+
+static volatile sig_atomic_t requested = 0;
+static uint64_t due_ns = 0;
+static int writing = 0;
+
+/* Mapping of resume_path between checkpoint_resume_board() and checkpoint_resume(). */
+static const struct checkpoint_header *resume_image = NULL;
+static size_t resume_size = 0;
+
+/*
+ * Same test as the observer's snapshot: nobody was between
+ * begin_board_change() and end_board_change(), and the epoch did not move
+ * while copying, so the matrix, owners, index and counters agree.
+ */
+static int copy_arena(char *image, uint32_t *epoch)
+{
+    const struct game_state *game = ARENA_SECTION(struct game_state, game);
+
+    for (int i = 0; i < CHECKPOINT_RETRIES; i++)
+    {
+        if (__atomic_load_n(&game->board_writers, __ATOMIC_SEQ_CST) != 0)
+        {
+            sched_yield();
+            continue;
+        }
+        uint32_t before = __atomic_load_n(&game->epoch, __ATOMIC_SEQ_CST);
+
+        memcpy(image, arena, arena->size);
+
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (before == __atomic_load_n(&game->epoch, __ATOMIC_SEQ_CST) &&
+            __atomic_load_n(&game->board_writers, __ATOMIC_SEQ_CST) == 0)
+        {
+            *epoch = before;
+            return 1;
+        }
+    }
+    return -1;
+}
+
+/*
+ * With lock set, only the copy is made under the global lock: syncing the
+ * file to disk and renaming it happen after it is released.
+ */
+static int write_checkpoint(int lock)
+{
+    char tmp[PATH_MAX];
+    size_t size;
+    int fd;
+
+    if (checkpoint_path == NULL || arena == NULL)
+        return -1;
+
+    size = sizeof(struct checkpoint_header) + arena->size;
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", checkpoint_path, getpid());
+    if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+    {
+        perror(tmp);
+        return -1;
+    }
+    if (ftruncate(fd, size) == -1)
+    {
+        perror("ftruncate (checkpoint)");
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+
+    struct checkpoint_header *h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    uint32_t epoch = 0;
+    int copied = -1;
+
+    close(fd);
+    if (h == MAP_FAILED)
+    {
+        perror("mmap (checkpoint)");
+        unlink(tmp);
+        return -1;
+    }
+
+    if (lock)
+        lock_global(LOCK_SITE_CHECKPOINT);
+    copied = copy_arena((char *)(h + 1), &epoch);
+    if (lock)
+        unlock_global();
+    if (copied == 1)
+    {
+        h->magic = CHECKPOINT_MAGIC;
+        h->version = CHECKPOINT_VERSION;
+        h->arena_version = ARENA_VERSION;
+        h->arena_size = arena->size;
+        h->taken_at = time(NULL);
+        h->epoch = epoch;
+        if (msync(h, size, MS_SYNC) == -1)
+        {
+            perror("msync (checkpoint)");
+            copied = -1;
+        }
+    }
+    munmap(h, size);
+
+    if (copied == 1 && rename(tmp, checkpoint_path) == -1)
+    {
+        perror(checkpoint_path);
+        copied = -1;
+    }
+    if (copied != 1)
+        unlink(tmp);
+    else
+        LOG(LOG_INFO, "Checkpoint written at board epoch %d.\n", (int)epoch);
+    return copied;
+}
+
+int checkpoint_write()
+{
+    return write_checkpoint(0);
+}
+
+void checkpoint_request(int sig)
+{
+    (void)sig;
+    requested = 1;
+}
+
+/*
+ * One thread of the process at a time, between two of its steps. The
+ * global lock stops the other players' moves for the copy; with striped
+ * or no locking a board too busy to copy is simply tried again next time.
+ */
+void checkpoint_if_due()
+{
+    uint64_t now = monotonic_ns();
+    uint64_t due = __atomic_load_n(&due_ns, __ATOMIC_RELAXED);
+
+    if (checkpoint_path == NULL || (!requested && now < due))
+        return;
+    if (__atomic_exchange_n(&writing, 1, __ATOMIC_ACQUIRE))
+        return;
+
+    __atomic_store_n(&due_ns, now + checkpoint_seconds * 1000000000ULL, __ATOMIC_RELAXED);
+    /* The first call only starts the clock. */
+    if (due != 0 || requested)
+    {
+        requested = 0;
+        if (write_checkpoint(1) == -1)
+            LOG(LOG_WARN, "Checkpoint skipped: the board kept changing.\n");
+    }
+    __atomic_store_n(&writing, 0, __ATOMIC_RELEASE);
+}
+
+void checkpoint_resume_board()
+{
+    struct stat st;
+    int fd = open(resume_path, O_RDONLY);
+
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        perror(resume_path);
+        exit(EXIT_FAILURE);
+    }
+    resume_size = st.st_size;
+    resume_image = resume_size >= sizeof(struct checkpoint_header) ? mmap(NULL, resume_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (resume_image == MAP_FAILED || resume_image->magic != CHECKPOINT_MAGIC || resume_image->version != CHECKPOINT_VERSION ||
+        resume_image->arena_size + sizeof(struct checkpoint_header) > resume_size)
+    {
+        fprintf(stderr, "'%s' is not a checkpoint.\n", resume_path);
+        exit(EXIT_FAILURE);
+    }
+
+    const struct arena *image = (const struct arena *)(resume_image + 1);
+
+    if (resume_image->arena_version != ARENA_VERSION || !arena_layout_is_valid(image, resume_image->arena_size))
+    {
+        fprintf(stderr, "'%s' was taken by another version (arena version %u, this is %u).\n", resume_path,
+                resume_image->arena_version, ARENA_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    board_width = image->width;
+    board_height = image->height;
+}
+
+/*
+ * Everything but the arena header comes from the image. What belonged to
+ * the processes of the checkpoint is reset: locks, turn, waiters, mail and
+ * subscriptions. Their roster slots stay in use with no pid, as orphans
+ * whose pieces wait on the board for the next player of their team.
+ */
+void checkpoint_resume()
+{
+    const char *image = (const char *)(resume_image + 1);
+    struct game_state *game = ARENA_SECTION(struct game_state, game);
+    int *roster = ARENA_SECTION(int, roster);
+    int orphans = 0;
+
+    memcpy((char *)arena + sizeof(struct arena), image + sizeof(struct arena), arena->size - sizeof(struct arena));
+
+    game->current_player_pid = 0;
+    game->lock_mode = lock_mode;
+    memset(&game->global_lock, 0, sizeof(game->global_lock));
+    memset(game->turn_wake, 0, sizeof(game->turn_wake));
+    game->processes = 0;
+    game->epoch_waiters = 0;
+    game->board_writers = 0;
+    game->reap_at = 0;
+    memset(game->roster_sub, 0, sizeof(game->roster_sub));
+    memset(ARENA_SECTION(struct broadcast_log, broadcasts), 0, MAX_TEAMS * sizeof(struct broadcast_log));
+    for (int i = 0; i < MAX_TEAMS; i++)
+        ring_init(ARENA_SECTION(struct ring, rings) + i);
+
+    for (int team = 0; team < MAX_TEAMS; team++)
+    {
+        for (int w = 0; w < ROSTER_WORDS; w++)
+        {
+            game->roster_orphan[team][w] |= game->roster_used[team][w];
+            orphans += __builtin_popcountll(game->roster_orphan[team][w]);
+        }
+        for (int slot = 0; slot < MAX_PROCESSES; slot++)
+            roster[team * MAX_PROCESSES + slot] = 0;
+    }
+
+    LOG(LOG_INFO, "Resumed a %dx%d board at epoch %d: %d players to adopt.\n", board_width, board_height,
+        (int)resume_image->epoch, orphans);
+    munmap((void *)resume_image, resume_size);
+    resume_image = NULL;
+}
@@ -0,0 +1,84 @@
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <futex.h>
+
+/* Returns 0 when woken (or when *addr was no longer expected), -1 on timeout. */
+int futex_wait(uint32_t *addr, uint32_t expected, int timeout_ms)
+{
+    struct timespec ts;
+    struct timespec *tsp = NULL;
+
+    if (timeout_ms >= 0)
+    {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+        tsp = &ts;
+    }
+
+    if (syscall(SYS_futex, addr, FUTEX_WAIT, expected, tsp, NULL, 0) == -1)
+    {
+        if (errno == ETIMEDOUT)
+            return -1;
+        if (errno != EAGAIN && errno != EINTR)
+            perror("futex wait");
+    }
+    return 0;
+}
+
+int futex_wake(uint32_t *addr, int count)
+{
+    long woken = syscall(SYS_futex, addr, FUTEX_WAKE, count, NULL, NULL, 0);
+
+    if (woken == -1)
+    {
+        perror("futex wake");
+        return -1;
+    }
+    return (int)woken;
+}
+
+/* FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline. */
+int futex_wait_bitset(uint32_t *addr, uint32_t expected, uint32_t bitset, int timeout_ms)
+{
+    struct timespec ts;
+    struct timespec *tsp = NULL;
+
+    if (timeout_ms >= 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += timeout_ms / 1000;
+        ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        tsp = &ts;
+    }
+
+    if (syscall(SYS_futex, addr, FUTEX_WAIT_BITSET, expected, tsp, NULL, bitset) == -1)
+    {
+        if (errno == ETIMEDOUT)
+            return -1;
+        if (errno != EAGAIN && errno != EINTR)
+            perror("futex wait");
+    }
+    return 0;
+}
+
+int futex_wake_bitset(uint32_t *addr, int count, uint32_t bitset)
+{
+    long woken = syscall(SYS_futex, addr, FUTEX_WAKE_BITSET, count, NULL, NULL, bitset);
+
+    if (woken == -1)
+    {
+        perror("futex wake");
+        return -1;
+    }
+    return (int)woken;
+}
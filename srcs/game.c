@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <ft_malloc.h>
 #include <unistd.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
@@ -7,237 +8,240 @@
 #include <globals.h>
 #include <math.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <lem_ipc.h>
-
-#define SHM_GAME_KEY 0xf001
-#define SHM_MATRIX_KEY 0x56789
-
-struct game_state
-{
-    int current_team;
-    int current_player_pid;
-    int game_started;
-};
+#include <locks.h>
+#include <futex.h>
+#include <spatial.h>
+#include <bitplane.h>
+#include <rng.h>
+#include <bench.h>
+#include <stats.h>
+#include <arena.h>
+#include <planner.h>
+#include <turns.h>
+#include <log.h>
+#include <trace.h>
+#include <checkpoint.h>
+#include <broadcast.h>
+#include <signal.h>
+
+#define START_WAIT_MS 1000
+#define TICK_MS 10
+/* How often some player checks that every registered one is still alive. */
+#define REAP_INTERVAL_NS 1000000000ULL
+/* Free cells the bitplanes may point at before placement gives up. */
+#define PLACEMENT_SCANS 64
 
 static struct game_state *game = NULL;
 static int *team_members[MAX_TEAMS] = {NULL};
-static int shm_matrix_id;
 static int *shared_matrix;
-static int my_position[2];
-static int game_shm_id;
-#define MATRIX(row, col) (shared_matrix[(row) * WIDTH + (col)])
-
-static void lock_semaphore()
+/* Roster slot (team * MAX_PROCESSES + slot + 1) that last claimed each cell. */
+static int *owners;
+static int owner_id = 0;
+static struct player *players = NULL;
+static int player_count = 0;
+static int player_team = -1;
+static int player_slot = -1;
+/* Set when our roster slot was an orphan of a resumed checkpoint. */
+static int adopted_slot = 0;
+#define MATRIX(row, col) (shared_matrix[(row) * board_width + (col)])
+
+/* Points every module at its section of the arena this process attached. */
+static void attach_sections()
 {
-    struct sembuf sop = {0, -1, 0};
-    if (semop(sem_id, &sop, 1) == -1)
+    game = ARENA_SECTION(struct game_state, game);
+    for (int i = 0; i < MAX_TEAMS; i++)
     {
-        perror("semop lock");
-        exit(EXIT_FAILURE);
+        team_members[i] = ARENA_SECTION(int, roster) + i * MAX_PROCESSES;
     }
+    shared_matrix = ARENA_SECTION(int, matrix);
+    owners = ARENA_SECTION(int, owners);
+    spatial_attach(shared_matrix, ARENA_SECTION(int, spatial));
+    bitplane_attach(ARENA_SECTION(uint64_t, planes));
+    planner_attach(game, shared_matrix);
+    locks_attach(&game->global_lock);
 }
 
-static void unlock_semaphore()
+/*
+ * Unlike the counters, the planes are set and cleared, not added to. Without
+ * locks a cell can be freed and claimed again before the one freeing it
+ * clears its bits, so whoever changed the cell reads it again after writing
+ * them, and writes them again until they match what it reads.
+ */
+static void sync_planes(int row, int col, int team)
 {
-    struct sembuf sop = {0, 1, 0};
-    if (semop(sem_id, &sop, 1) == -1)
-    {
-        perror("semop unlock");
-        exit(EXIT_FAILURE);
-    }
-}
+    int value = __atomic_load_n(&MATRIX(row, col), __ATOMIC_SEQ_CST);
+    int seen;
 
-void detach_matrix()
-{
-    if (shmdt(shared_matrix) == -1)
+    do
     {
-        perror("shmdt (matrix)");
-    }
+        seen = value;
+        bitplane_sync(row, col, team, seen);
+        value = __atomic_load_n(&MATRIX(row, col), __ATOMIC_SEQ_CST);
+    } while (value != seen);
 }
 
-void init_shared_matrix()
+/*
+ * Live pieces per team and the number of teams with any piece left, kept in
+ * step with every claim and release so win and start checks are O(1), along
+ * with the spatial index and the bitplanes. An empty cell is 0, so team 0
+ * pieces are not counted, as on the board.
+ */
+static void count_piece(int row, int col, int team, int delta)
 {
-    size_t matrix_size = WIDTH * HEIGHT * sizeof(int);
+    if (team <= 0 || team >= MAX_TEAMS)
+        return;
 
-    shm_matrix_id = shmget(SHM_MATRIX_KEY, matrix_size, IPC_CREAT | 0666);
-    if (shm_matrix_id == -1)
-    {
-        perror("shmget (matrix)");
-        exit(EXIT_FAILURE);
-    }
+    spatial_add(row, col, team, delta);
+    sync_planes(row, col, team);
 
-    shared_matrix = (int *)shmat(shm_matrix_id, NULL, 0);
-    if (shared_matrix == (void *)-1)
-    {
-        perror("shmat (matrix)");
-        exit(EXIT_FAILURE);
-    }
-
-    lock_semaphore();
-    struct shmid_ds shm_info;
-    shmctl(shm_matrix_id, IPC_STAT, &shm_info);
-    if (shm_info.shm_nattch == 1)
-    {
-        for (int i = 0; i < WIDTH * HEIGHT; i++)
-        {
-            shared_matrix[i] = 0;
-        }
-        printf("Shared matrix initialized (ID: %d, Size: %ld bytes).\n", shm_matrix_id, matrix_size);
-    }
-    unlock_semaphore();
+    int before = __atomic_fetch_add(&game->team_pieces[team], delta, __ATOMIC_ACQ_REL);
+    if (before == 0 && delta > 0)
+        __atomic_add_fetch(&game->active_teams, 1, __ATOMIC_ACQ_REL);
+    else if (before + delta == 0)
+        __atomic_sub_fetch(&game->active_teams, 1, __ATOMIC_ACQ_REL);
 }
 
-
 int update_matrix_element(int row, int col, int value)
 {
-    if (row < 0 || row >= HEIGHT || col < 0 || col >= WIDTH)
+    if (row < 0 || row >= board_height || col < 0 || col >= board_width)
     {
         return -1;
     }
-    if (MATRIX(row, col) != 0)
+
+    /* A single CAS claims the cell, so this is safe even without any lock. */
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&MATRIX(row, col), &expected, value, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
     {
         return -1;
-    } 
-    MATRIX(row, col) = value;
-    
+    }
+    __atomic_store_n(&owners[row * board_width + col], owner_id, __ATOMIC_RELAXED);
+    count_piece(row, col, value, 1);
+
     return 1;
 }
 
-void print_matrix()
+/*
+ * Every visible board change bumps the epoch. Players with nothing to do
+ * sleep on it instead of polling, and are only woken if somebody waits.
+ */
+static void board_changed()
 {
-    printf("\033[H\033[J");
+    __atomic_add_fetch(&game->epoch, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&game->epoch_waiters, __ATOMIC_SEQ_CST) > 0)
+        futex_wake(&game->epoch, INT_MAX);
+}
 
-    printf("Game Board:\n");
-    for (int r = 0; r < HEIGHT; r++)
-    {
-        for (int c = 0; c < WIDTH; c++)
-        {
-            if (MATRIX(r, c) == 0)
-            {
-                printf(". ");
-            }
-            else if (MATRIX(r, c) == 1)
-            {
-                printf("\033[31m1 \033[0m"); // Team 1 (red)
-            }
-            else if (MATRIX(r, c) == 2)
-            {
-                printf("\033[34m2 \033[0m"); // Team 2 (blue)
-            }
-            else if (MATRIX(r, c) == 3)
-            {
-                printf("\033[32m3 \033[0m"); // Team 3 (green)
-            }
-            else if (MATRIX(r, c) == 4)
-            {
-                printf("\033[33m4 \033[0m"); // Team 4 (yellow)
-            }
-            else if (MATRIX(r, c) == 5)
-            {
-                printf("\033[35m5 \033[0m"); // Team 5 (purple)
-            }
-            else if(MATRIX(r, c) == 6)
-            {
-                printf("\033[36m6 \033[0m"); // Team 6 (cyan)
-            }
-            else if (MATRIX(r, c) == 7)
-            {
-                printf("\033[37m7 \033[0m"); // Team 7 (white)
-            }
-            else if (MATRIX(r, c) == 8)
-            {
-                printf("\033[91m8 \033[0m"); // Team 8 (light red)
-            }
-            else if (MATRIX(r, c) == 9)
-            {
-                printf("\033[94m9 \033[0m"); // Team 9 (light blue)
-            }
-            else
-            {
-                printf("? ");
-            }
-        }
-        printf("\n");
-    }
+/*
+ * Matrix writes are bracketed by these so an observer copying the board
+ * without any lock can tell whether its snapshot raced with a change.
+ */
+static void begin_board_change()
+{
+    __atomic_add_fetch(&game->board_writers, 1, __ATOMIC_SEQ_CST);
+}
 
-    fflush(stdout);
+static void end_board_change(int changed)
+{
+    if (changed)
+        board_changed();
+    __atomic_sub_fetch(&game->board_writers, 1, __ATOMIC_SEQ_CST);
 }
 
-void restore_player_position(int team)
+uint32_t board_epoch()
 {
-    if (my_position[0] < 0 || my_position[0] >= HEIGHT || my_position[1] < 0 || my_position[1] >= WIDTH)
-        return;
+    return __atomic_load_n(&game->epoch, __ATOMIC_ACQUIRE);
+}
 
-    lock_semaphore();
-    printf("Restoring position [%d][%d] for Team %d.\n", my_position[0], my_position[1], team);
+static void wait_for_board_change(uint32_t seen, int timeout_ms)
+{
+    __atomic_add_fetch(&game->epoch_waiters, 1, __ATOMIC_SEQ_CST);
+    futex_wait(&game->epoch, seen, timeout_ms);
+    __atomic_sub_fetch(&game->epoch_waiters, 1, __ATOMIC_SEQ_CST);
+}
 
-    if (MATRIX(my_position[0], my_position[1]) == team)
-    {
-        MATRIX(my_position[0], my_position[1]) = 0;
-        printf("Position [%d][%d] restored.\n", my_position[0], my_position[1]);
-    }
-    else
+/* Empties a cell only if it still belongs to team. */
+static int release_matrix_element(int row, int col, int team)
+{
+    int expected = team;
+    if (!__atomic_compare_exchange_n(&MATRIX(row, col), &expected, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
     {
-        printf("Position [%d][%d] not restored: occupied by another team or empty.\n", my_position[0], my_position[1]);
+        return -1;
     }
+    count_piece(row, col, team, -1);
 
-    unlock_semaphore();
+    return 1;
 }
 
-
-void cleanup_shared_matrix()
+static void restore_player_position(struct player *p)
 {
-    struct shmid_ds shm_info;
+    if (p->position[0] < 0 || p->position[0] >= board_height || p->position[1] < 0 || p->position[1] >= board_width)
+        return;
 
-    if (shmdt(shared_matrix) == -1)
-    {
-        perror("shmdt (matrix)");
-    }
+    lock_global(LOCK_SITE_CLEANUP);
+    lock_cells(LOCK_SITE_CLEANUP, p->position[0], p->position[1], p->position[0], p->position[1]);
+    LOG(LOG_INFO, "Restoring position [%d][%d] for Team %d.\n", p->position[0], p->position[1], p->team);
 
-    if (shmctl(shm_matrix_id, IPC_STAT, &shm_info) == 0 && shm_info.shm_nattch == 0)
+    begin_board_change();
+    int restored = release_matrix_element(p->position[0], p->position[1], p->team) == 1;
+    end_board_change(restored);
+    if (restored)
     {
-        if (shmctl(shm_matrix_id, IPC_RMID, NULL) == -1)
-        {
-            perror("shmctl (matrix)");
-        }
-        else
-        {
-            printf("Shared matrix removed (ID: %d).\n", shm_matrix_id);
-        }
+        trace_record(TRACE_LEAVE, p->team, 0, p->position[0], p->position[1], 0, 0);
+        LOG(LOG_INFO, "Position [%d][%d] restored.\n", p->position[0], p->position[1]);
     }
     else
     {
-        printf("Shared matrix still in use by other processes (ID: %d).\n", shm_matrix_id);
+        LOG(LOG_INFO, "Position [%d][%d] not restored: occupied by another team or empty.\n", p->position[0], p->position[1]);
     }
 
-    printf("Shared matrix cleanup complete.\n");
+    unlock_cells(p->position[0], p->position[1], p->position[0], p->position[1]);
+    unlock_global();
 }
 
-void place_player_first_spot(int team)
+
+/* Gives back the cells of every player of this process still on the board. */
+void restore_players()
 {
-    for (int r = 0; r < HEIGHT; r++)
+    for (int i = 0; i < player_count; i++)
     {
-        for (int c = 0; c < WIDTH; c++)
+        restore_player_position(&players[i]);
+    }
+}
+
+static int place_player_first_spot(struct player *p)
+{
+    int r;
+    int c;
+
+    /* The planes may lag a concurrent claim by a moment; just look again. */
+    for (int scans = 0; scans < PLACEMENT_SCANS && bitplane_find_free(&r, &c) == 1; scans++)
+    {
+        lock_cells(LOCK_SITE_PLACEMENT, r, c, r, c);
+        begin_board_change();
+        int claimed = update_matrix_element(r, c, p->team) == 1;
+        end_board_change(claimed);
+        if (claimed)
+            trace_record(TRACE_JOIN, p->team, 0, r, c, 0, 0);
+        unlock_cells(r, c, r, c);
+        if (claimed)
         {
-            if (MATRIX(r, c) == 0)
-            {
-                MATRIX(r,c) = team;
-                my_position[0] = r;
-                my_position[1] = c;
-                return;
-            }
+            p->position[0] = r;
+            p->position[1] = c;
+            return 1;
         }
     }
 
-    my_position[0] = -1;
-    my_position[1] = -1;
-    fprintf(stderr, "Unable to set an initial position for player...\n");
-    unlock_semaphore();
-    cleanup();
-    exit(EXIT_FAILURE);
+    p->position[0] = -1;
+    p->position[1] = -1;
+    return -1;
 }
 
-void place_player_random(int team)
+int place_player_random(struct player *p)
 {
     int tries = 0;
     int ret = 0;
@@ -246,38 +250,75 @@ void place_player_random(int team)
 
     while (tries < 5)
     {
-        row = rand() % HEIGHT;
-        col = rand() % WIDTH;
-        ret = update_matrix_element(row, col, team);
+        row = rng_below(&p->rng, board_height);
+        col = rng_below(&p->rng, board_width);
+        lock_cells(LOCK_SITE_PLACEMENT, row, col, row, col);
+        begin_board_change();
+        ret = update_matrix_element(row, col, p->team);
+        end_board_change(ret == 1);
+        if (ret == 1)
+            trace_record(TRACE_JOIN, p->team, 0, row, col, 0, 0);
+        unlock_cells(row, col, row, col);
         if (ret == 1)
             break;
         tries++;
     }
     if (ret != 1)
     {
-        place_player_first_spot(team);
+        return place_player_first_spot(p);
     }
-    else
+
+    p->position[0] = row;
+    p->position[1] = col;
+    return 1;
+}
+
+/*
+ * Moves our piece to a neighbouring cell if it is free. With striped locking
+ * the tiles of both cells are held; in lock-free mode nothing is, so the
+ * destination is claimed first and given back if our source cell turns out
+ * to have been captured in the meantime.
+ */
+static int claim_move(struct player *p, int new_row, int new_col)
+{
+    int ret = -1;
+
+    if (new_row < 0 || new_row >= board_height || new_col < 0 || new_col >= board_width)
+        return -1;
+
+    lock_cells(LOCK_SITE_MOVE, p->position[0], p->position[1], new_row, new_col);
+    begin_board_change();
+    if (update_matrix_element(new_row, new_col, p->team) == 1)
     {
-        my_position[0] = row;
-        my_position[1] = col;
+        if (release_matrix_element(p->position[0], p->position[1], p->team) == 1)
+            ret = 1;
+        else
+            release_matrix_element(new_row, new_col, p->team);
     }
+    end_board_change(ret == 1);
+    if (ret == 1)
+        trace_record(TRACE_MOVE, p->team, 0, p->position[0], p->position[1], new_row, new_col);
+    unlock_cells(p->position[0], p->position[1], new_row, new_col);
+
+    return ret;
 }
 
-int move_player(int new_row, int new_col, int team)
+int move_player(struct player *p, int new_row, int new_col)
 {
-    if (update_matrix_element(new_row, new_col, team) == 1)
+    int old_row = p->position[0];
+    int old_col = p->position[1];
+
+    if (claim_move(p, new_row, new_col) == 1)
     {
-        printf("Player %d from Team %d moved from [%d][%d] to [%d][%d].\n", getpid(), team, my_position[0], my_position[1], new_row, new_col);
-        MATRIX(my_position[0], my_position[1]) = 0;
-        my_position[0] = new_row;
-        my_position[1] = new_col;
+        LOG(LOG_DEBUG, "Player %d from Team %d moved from [%d][%d] to [%d][%d].\n", getpid(), p->team, old_row, old_col, new_row, new_col);
+        p->position[0] = new_row;
+        p->position[1] = new_col;
         return 1;
     }
     return -1;
 }
 
-void move_player_one_square_random(int team)
+void move_player_one_square_random(struct player *p)
 {
     int directions[4][2] = {
         {-1, 0}, // Up
@@ -289,7 +330,7 @@ void move_player_one_square_random(int team)
     /* Shuffle the directions array to randomize movement */
     for (int i = 0; i < 4; i++)
     {
-        int j = rand() % 4;
+        int j = rng_below(&p->rng, 4);
         int temp[2] = {directions[i][0], directions[i][1]};
         directions[i][0] = directions[j][0];
         directions[i][1] = directions[j][1];
@@ -299,321 +340,634 @@ void move_player_one_square_random(int team)
 
     for (int i = 0; i < 4; i++)
     {
-        int new_row = my_position[0] + directions[i][0];
-        int new_col = my_position[1] + directions[i][1];
+        int new_row = p->position[0] + directions[i][0];
+        int new_col = p->position[1] + directions[i][1];
 
-        if (new_row >= 0 && new_row < HEIGHT && new_col >= 0 && new_col < WIDTH)
+        if (claim_move(p, new_row, new_col) == 1)
         {
-            if (MATRIX(new_row, new_col) == 0)
-            {
-                MATRIX(my_position[0], my_position[1]) = 0; /* Clear current position */
-                MATRIX(new_row, new_col) = team;            /* Mark new position with the team */
-                my_position[0] = new_row;
-                my_position[1] = new_col;
+            p->position[0] = new_row;
+            p->position[1] = new_col;
 
-                printf("Player %d from Team %d moved to [%d, %d].\n", getpid(), team, new_row, new_col);
-                return;
-            }
+            LOG(LOG_DEBUG, "Player %d from Team %d moved to [%d, %d].\n", getpid(), p->team, new_row, new_col);
+            return;
         }
     }
 
-    printf("Player %d from Team %d could not move.\n", getpid(), team);
+    LOG(LOG_DEBUG, "Player %d from Team %d could not move.\n", getpid(), p->team);
 }
 
-int manhattan_distance(int x1, int y1, int x2, int y2)
+/*
+ * Heads for the cell the team planner gave us, going round whatever is in
+ * the way, then stays there until the teammate on the other side arrives:
+ * the one exception to players always moving.
+ */
+static int move_to_flank(struct player *p, int goal_row, int goal_col)
 {
-    return abs(x1 - x2) + abs(y1 - y2);
-}
+    int row_step = (goal_row > p->position[0]) - (goal_row < p->position[0]);
+    int col_step = (goal_col > p->position[1]) - (goal_col < p->position[1]);
 
-int move_towards_nearest_opponent(int team)
-{
-    int nearest_distance = WIDTH * HEIGHT;
-    int target_row = -1, target_col = -1;
+    if (row_step == 0 && col_step == 0)
+    {
+        LOG(LOG_DEBUG, "Player %d from Team %d holds [%d, %d] for a capture.\n", getpid(), p->team, goal_row, goal_col);
+        return 1;
+    }
 
-    for (int r = 0; r < HEIGHT; r++)
+    if ((row_step != 0 && move_player(p, p->position[0] + row_step, p->position[1]) == 1) ||
+        (col_step != 0 && move_player(p, p->position[0], p->position[1] + col_step) == 1))
     {
-        for (int c = 0; c < WIDTH; c++)
-        {
-            if (MATRIX(r, c) != 0 && MATRIX(r, c) != team)
-            {
-                int distance = manhattan_distance(my_position[0], my_position[1], r, c);
-                if (distance < nearest_distance)
-                {
-                    nearest_distance = distance;
-                    target_row = r;
-                    target_col = c;
-                }
-            }
-        }
+        return 1;
     }
 
-    if (target_row == -1 || target_col == -1)
+    move_player_one_square_random(p);
+    return 1;
+}
+
+int move_towards_nearest_opponent(struct player *p)
+{
+    int target_row, target_col;
+
+    if (team_planning && planner_goal(p, &target_row, &target_col) == 1)
+        return move_to_flank(p, target_row, target_col);
+
+    if (spatial_nearest_enemy(p->position[0], p->position[1], p->team, &target_row, &target_col) == -1)
     {
-        printf("No opponents nearby for Team %d at [%d, %d].\n", team, my_position[0], my_position[1]);
+        LOG(LOG_DEBUG, "No opponents nearby for Team %d at [%d, %d].\n", p->team, p->position[0], p->position[1]);
         return 2;
     }
 
-    int new_row = my_position[0];
-    int new_col = my_position[1];
+    int new_row = p->position[0];
+    int new_col = p->position[1];
 
-    if (my_position[0] < target_row)
+    if (p->position[0] < target_row)
     {
         new_row++; /* Move down */
     }
-    else if (my_position[0] > target_row)
+    else if (p->position[0] > target_row)
     {
         new_row--; /* Move up */
     }
-    else if (my_position[1] < target_col)
+    else if (p->position[1] < target_col)
     {
         new_col++; /* Move right */
     }
-    else if (my_position[1] > target_col)
+    else if (p->position[1] > target_col)
     {
         new_col--; /* Move left */
     }
 
-    if (move_player(new_row, new_col, team) == 1)
+    if (move_player(p, new_row, new_col) == 1)
     {
-        printf("Player %d from Team %d moved towards opponent at [%d, %d].\n", getpid(), team, target_row, target_col);
+        LOG(LOG_DEBUG, "Player %d from Team %d moved towards opponent at [%d, %d].\n", getpid(), p->team, target_row, target_col);
     }
     else
     {
         /* players must allways move! */
-        move_player_one_square_random(team);
+        move_player_one_square_random(p);
     }
     return 1;
 }
 
-int have_i_lost(int team)
+int have_i_lost(struct player *p)
 {
-    if (MATRIX(my_position[0], my_position[1]) != team)
+    if (MATRIX(p->position[0], p->position[1]) != p->team)
     {
-        printf("player was at [%d, %d]\n", my_position[0], my_position[1]);
+        LOG(LOG_INFO, "player was at [%d, %d]\n", p->position[0], p->position[1]);
         return 1;
     }
 
     return -1;
 }
 
-int have_i_won(int team)
+int have_i_won(struct player *p)
 {
-    for (int r = 0; r < HEIGHT; r++)
-    {
-        for (int c = 0; c < WIDTH; c++)
-        {
-            if (MATRIX(r, c) != 0 && MATRIX(r, c) != team)
-            {
-                return -1;
-            }
-        }
-    }
+    int teams = __atomic_load_n(&game->active_teams, __ATOMIC_ACQUIRE);
 
-    return 1;
+    /* A move briefly counts the piece twice, but never drops a team to zero. */
+    if (__atomic_load_n(&game->team_pieces[p->team], __ATOMIC_ACQUIRE) > 0)
+        teams--;
+
+    return teams == 0 ? 1 : -1;
 }
 
+/* The team sandwiching the team piece at row, col, or 0 if none does. */
 int is_piece_surrounded(int row, int col, int team)
 {
-    if (col > 0 && col < WIDTH - 1 &&
+    if (col > 0 && col < board_width - 1 &&
         MATRIX(row, col - 1) != 0 && MATRIX(row, col - 1) != team &&
         MATRIX(row, col + 1) != 0 && MATRIX(row, col + 1) != team &&
         MATRIX(row, col - 1) == MATRIX(row, col + 1))
     {
-        return 1;
+        return MATRIX(row, col - 1);
     }
 
-    if (row > 0 && row < HEIGHT - 1 &&
+    if (row > 0 && row < board_height - 1 &&
         MATRIX(row - 1, col) != 0 && MATRIX(row - 1, col) != team &&
         MATRIX(row + 1, col) != 0 && MATRIX(row + 1, col) != team &&
         MATRIX(row - 1, col) == MATRIX(row + 1, col))
     {
-        return 1;
+        return MATRIX(row - 1, col);
     }
 
-    if (row > 0 && row < HEIGHT - 1 && col > 0 && col < WIDTH - 1)
+    if (row > 0 && row < board_height - 1 && col > 0 && col < board_width - 1)
     {
         if (MATRIX(row - 1, col - 1) != 0 && MATRIX(row - 1, col - 1) != team &&
             MATRIX(row + 1, col + 1) != 0 && MATRIX(row + 1, col + 1) != team &&
             MATRIX(row - 1, col - 1) == MATRIX(row + 1, col + 1))
         {
-            return 1;
+            return MATRIX(row - 1, col - 1);
         }
         if (MATRIX(row - 1, col + 1) != 0 && MATRIX(row - 1, col + 1) != team &&
             MATRIX(row + 1, col - 1) != 0 && MATRIX(row + 1, col - 1) != team &&
             MATRIX(row - 1, col + 1) == MATRIX(row + 1, col - 1))
         {
-            return 1;
+            return MATRIX(row - 1, col + 1);
         }
     }
 
     return 0;
 }
 
-void check_captured_enemy(int team)
+/*
+ * Only a piece arriving somewhere can complete a sandwich, so after a claim
+ * the pieces that may have been captured are the ones in the 3x3
+ * neighbourhood of the claimed cell (itself included). Emptying a cell can
+ * never surround anything, so sources of moves need no check.
+ */
+static void check_captures_around(int row, int col)
 {
-    for (int r = 0; r < HEIGHT; r++)
+    for (int r = row - 1; r <= row + 1; r++)
     {
-        for (int c = 0; c < WIDTH; c++)
+        for (int c = col - 1; c <= col + 1; c++)
         {
-            if (MATRIX(r, c) == team && is_piece_surrounded(r, c, team))
+            if (r < 0 || r >= board_height || c < 0 || c >= board_width)
+                continue;
+
+            int victim = MATRIX(r, c);
+            if (victim == 0 || !is_piece_surrounded(r, c, victim))
+                continue;
+
+            lock_area(LOCK_SITE_CAPTURE, r, c);
+            begin_board_change();
+            /* The piece that arrived may complete another team's sandwich, so credit that team. */
+            int captor = is_piece_surrounded(r, c, victim);
+            int captured = captor != 0 && release_matrix_element(r, c, victim) == 1;
+            end_board_change(captured);
+            if (captured)
             {
-                printf("Player %d from Team %d captured an enemy at [%d, %d].\n", getpid(), team, r, c);
-                MATRIX(r, c) = 0;
+                trace_record(TRACE_CAPTURE, captor, victim, r, c, 0, 0);
+                LOG(LOG_INFO, "Team %d captured a Team %d piece at [%d, %d].\n", captor, victim, r, c);
             }
+            unlock_area(r, c);
         }
     }
 }
 
-void has_game_started()
+/*
+ * Full board pass over the bitplanes asserting the incremental engine missed
+ * nothing and the piece counters agree with the board.
+ */
+static void verify_no_capture_left()
 {
-    int team_has_players[MAX_TEAMS];
-    int total_teams = 0;
+    int r, c, victim;
+
+    if (bitplane_find_surrounded(&r, &c, &victim) == 1)
+    {
+        fprintf(stderr, "Surrounded Team %d piece left at [%d, %d].\n", victim, r, c);
+        ft_assert(0, "incremental capture check missed a piece");
+    }
+
+    for (int t = 1; t < MAX_TEAMS; t++)
+    {
+        ft_assert(bitplane_count(t) == game->team_pieces[t], "piece counter out of sync with the board");
+    }
+}
+
+void check_captured_enemy(struct player *p)
+{
+    int site = lock_phase(LOCK_SITE_CAPTURE);
+
+    check_captures_around(p->position[0], p->position[1]);
+
+    /* Other lock modes let moves land while we scan, so only verify here. */
+    if (verify_captures && lock_mode == LOCK_GLOBAL)
+        verify_no_capture_left();
+    lock_phase(site);
+}
+
+static void render()
+{
+    int site = lock_phase(LOCK_SITE_RENDER);
+
+    print_matrix(shared_matrix);
+    lock_phase(site);
+}
 
+void has_game_started()
+{
     if (game->game_started == 1)
         return;
 
-    memset(team_has_players, 0, sizeof(team_has_players));
+    if (__atomic_load_n(&game->active_teams, __ATOMIC_ACQUIRE) > 1)
+    {
+        game->game_started = 1;
+        board_changed();
+    }
+}
 
-    for (int r = 0; r < HEIGHT; r++)
+/*
+ * Takes the lowest free bit of the team's roster bitmap with a CAS, so a
+ * join costs a couple of words whatever the size of the team.
+ */
+static int alloc_slot(int team)
+{
+    for (int w = 0; w < ROSTER_WORDS; w++)
     {
-        for (int c = 0; c < WIDTH; c++)
+        uint64_t *word = &game->roster_used[team][w];
+        int bits = MAX_PROCESSES - w * 64 < 64 ? MAX_PROCESSES - w * 64 : 64;
+        uint64_t valid = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+        uint64_t used = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+
+        while ((~used & valid) != 0)
         {
-            if (MATRIX(r, c) != 0)
-            {
-                team_has_players[MATRIX(r, c)] += 1;
-                if (team_has_players[MATRIX(r, c)] == 1)
-                {
-                    total_teams++;
-                }
-                if (total_teams > 1)
-                {
-                    game->game_started = 1;
-                    return;
-                }
-            }
+            int bit = __builtin_ctzll(~used & valid);
+
+            if (__atomic_compare_exchange_n(word, &used, used | (1ULL << bit), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                return w * 64 + bit;
         }
     }
-    return;
+    return -1;
 }
 
-void register_player(int team)
+/* Takes over the lowest orphan slot of the team, already marked in use. */
+static int adopt_slot(int team)
 {
-    lock_semaphore();
-    int registered = 0;
-    for (int i = 0; i < MAX_PROCESSES; i++)
+    for (int w = 0; w < ROSTER_WORDS; w++)
     {
-        if (team_members[team][i] == getpid())
+        uint64_t *word = &game->roster_orphan[team][w];
+        uint64_t orphans = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+
+        while (orphans != 0)
         {
-            registered = 1;
-            break;
+            int bit = __builtin_ctzll(orphans);
+
+            if (__atomic_compare_exchange_n(word, &orphans, orphans & ~(1ULL << bit), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                return w * 64 + bit;
         }
     }
+    return -1;
+}
 
-    if (!registered)
+static void free_slot(int team, int slot)
+{
+    __atomic_fetch_and(&game->roster_used[team][slot / 64], ~(1ULL << (slot % 64)), __ATOMIC_ACQ_REL);
+}
+
+/*
+ * Returns the roster slot of this process in its team, -1 if it is full.
+ * An orphan slot is taken first, so its pieces get a player again.
+ */
+int register_player(int team)
+{
+    int slot = adopt_slot(team);
+
+    adopted_slot = slot != -1;
+    if (slot == -1)
+        slot = alloc_slot(team);
+
+    if (slot != -1)
     {
-        for (int i = 0; i < MAX_PROCESSES; i++)
-        {
-            if (team_members[team][i] == 0)
-            {
-                team_members[team][i] = getpid();
-                break;
-            }
-        }
+        game->roster_sub[team][slot] = team_subscription() + 1;
+        owner_id = team * MAX_PROCESSES + slot + 1;
+        __atomic_store_n(&team_members[team][slot], getpid(), __ATOMIC_RELEASE);
     }
 
+    lock_global(LOCK_SITE_JOIN);
     has_game_started();
+    unlock_global();
+    return slot;
+}
+
+/* Frees our roster slot and gives the turn away; the semaphore is held. */
+void unregister_player()
+{
+    if (player_slot == -1)
+        return;
 
-    unlock_semaphore();
+    __atomic_store_n(&team_members[player_team][player_slot], 0, __ATOMIC_RELEASE);
+    game->roster_sub[player_team][player_slot] = 0;
+    free_slot(player_team, player_slot);
+    player_slot = -1;
+    turn_leave();
 }
 
-void actual_play(int team)
+/*
+ * Cells of the team still claimed by roster slot id, their positions going
+ * to the first max players. Returns how many there are.
+ */
+static int find_owned_cells(int team, int id, struct player *list, int max)
 {
-    register_player(team);
+    int found = 0;
 
-    while (1)
+    for (int r = 0; r < board_height; r++)
     {
-        lock_semaphore();
-
-        if (game->game_started == 0)
+        for (int c = 0; c < board_width; c++)
         {
-            print_matrix();
-            printf("Waiting for game to start...\n");
-            unlock_semaphore();
-            usleep(50000);
-            continue;            
+            if (__atomic_load_n(&owners[r * board_width + c], __ATOMIC_RELAXED) != id || MATRIX(r, c) != team)
+                continue;
+            if (found < max)
+            {
+                list[found].position[0] = r;
+                list[found].position[1] = c;
+            }
+            found++;
         }
+    }
+    return found;
+}
+
+/*
+ * Empties every cell a dead roster slot still holds, returning how many.
+ * The locks it may have died holding are recovered first: lock_board()
+ * skips its ticket, and the kernel undid its tiles (SEM_UNDO).
+ */
+static int release_owned_cells(int team, int id)
+{
+    int freed = 0;
 
-        if (have_i_lost(team) == 1)
+    lock_board(LOCK_SITE_CLEANUP);
+    for (int r = 0; r < board_height; r++)
+    {
+        for (int c = 0; c < board_width; c++)
         {
-            // print_matrix();
-            printf("Player %d from Team %d has lost.\n", getpid(), team);
-            my_position[0] = -1;
-            my_position[1] = -1;
-            unlock_semaphore();
-            break;
+            if (__atomic_load_n(&owners[r * board_width + c], __ATOMIC_RELAXED) != id || MATRIX(r, c) != team)
+                continue;
+
+            lock_cells(LOCK_SITE_CLEANUP, r, c, r, c);
+            begin_board_change();
+            int released = release_matrix_element(r, c, team) == 1;
+            end_board_change(released);
+            if (released)
+                trace_record(TRACE_LEAVE, team, 0, r, c, 0, 0);
+            unlock_cells(r, c, r, c);
+            freed += released;
         }
+    }
+    unlock_board();
+    return freed;
+}
+
+/*
+ * Undoes what cleanup() would have done for a player killed without
+ * running it. Whoever swaps its pid out of the roster does the reaping, so
+ * each dead player is reaped exactly once; its slot bit goes last, once
+ * nothing refers to the slot any more.
+ */
+static void reap_player(int team, int slot, int pid)
+{
+    int expected = pid;
+
+    if (!__atomic_compare_exchange_n(&team_members[team][slot], &expected, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return;
+
+    int freed = release_owned_cells(team, team * MAX_PROCESSES + slot + 1);
+    int sub = game->roster_sub[team][slot] - 1;
 
-        if (have_i_won(team) == 1)
+    if (sub >= 0)
+        broadcast_unsubscribe(ARENA_SECTION(struct broadcast_log, broadcasts) + team, sub);
+    game->roster_sub[team][slot] = 0;
+    __atomic_sub_fetch(&game->processes, 1, __ATOMIC_ACQ_REL);
+    free_slot(team, slot);
+    turn_forfeit(pid, team);
+
+    LOG(LOG_INFO, "Reaped dead player %d of Team %d: %d cells freed.\n", pid, team, freed);
+}
+
+/*
+ * Killed players stay zombies until their parent waits for them, and
+ * kill() still finds those, so /proc has the last word.
+ */
+int player_is_dead(int pid)
+{
+    char path[64];
+    char stat[256];
+    FILE *f;
+    char *end;
+
+    if (kill(pid, 0) == -1)
+        return errno == ESRCH;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    if ((f = fopen(path, "r")) == NULL)
+        return 0;
+    end = fgets(stat, sizeof(stat), f) != NULL ? strrchr(stat, ')') : NULL;
+    fclose(f);
+    return end != NULL && (end[2] == 'Z' || end[2] == 'X');
+}
+
+/* Only walks the slots in use, and only asks the kernel about those. */
+void reap_dead_players()
+{
+    for (int team = 0; team < MAX_TEAMS; team++)
+    {
+        for (int w = 0; w < ROSTER_WORDS; w++)
         {
-            // print_matrix();
-            printf("Player %d from Team %d has won!\n", getpid(), team);
-            unlock_semaphore();
-            break;
+            uint64_t used = __atomic_load_n(&game->roster_used[team][w], __ATOMIC_ACQUIRE);
+
+            while (used != 0)
+            {
+                int slot = w * 64 + __builtin_ctzll(used);
+                int pid = __atomic_load_n(&team_members[team][slot], __ATOMIC_ACQUIRE);
+
+                used &= used - 1;
+                if (pid != 0 && pid != getpid() && player_is_dead(pid))
+                    reap_player(team, slot, pid);
+            }
         }
+    }
+}
+
+/* One player of the whole game checks every REAP_INTERVAL_NS. */
+static void reap_if_due()
+{
+    uint64_t now = monotonic_ns();
+    uint64_t due = __atomic_load_n(&game->reap_at, __ATOMIC_RELAXED);
+
+    if (now < due || !__atomic_compare_exchange_n(&game->reap_at, &due, now + REAP_INTERVAL_NS, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return;
+    reap_dead_players();
+}
+
+static int step(struct player *p)
+{
+    p->seen_epoch = board_epoch();
+
+    lock_board(LOCK_SITE_MOVE);
+
+    has_game_started();
+    if (game->game_started == 0)
+    {
+        if (render_board)
+            render();
+        LOG(LOG_DEBUG, "Waiting for game to start...\n");
+        unlock_board();
+        return PLAYER_WAITING;
+    }
+
+    /* With --ticks, a player leaves once it has had its share of steps. */
+    if (max_ticks != 0 && p->steps >= max_ticks)
+    {
+        unlock_board();
+        return PLAYER_DONE;
+    }
+    p->steps++;
+
+    if (have_i_lost(p) == 1)
+    {
+        LOG(LOG_INFO, "Player %d from Team %d has lost.\n", getpid(), p->team);
+        p->position[0] = -1;
+        p->position[1] = -1;
+        unlock_board();
+        return PLAYER_DONE;
+    }
+
+    if (have_i_won(p) == 1)
+    {
+        LOG(LOG_INFO, "Player %d from Team %d has won!\n", getpid(), p->team);
+        unlock_board();
+        return PLAYER_DONE;
+    }
+
+    move_towards_nearest_opponent(p);
+    check_captured_enemy(p);
+    if (render_board)
+        render();
+
+    p->seen_epoch = board_epoch();
+    unlock_board();
+    return PLAYER_MOVED;
+}
+
+/*
+ * One decide-and-move step. p->seen_epoch is left at the board epoch the
+ * player last looked at, so the caller knows what to wait for.
+ */
+int player_step(struct player *p)
+{
+    uint64_t start;
+    int state;
+
+    if (!bench_mode)
+        return step(p);
 
-        move_towards_nearest_opponent(team);
-        check_captured_enemy(team);
-        print_matrix();
+    start = monotonic_ns();
+    state = step(p);
+    bench_step(state, start, p->steps);
+    return state;
+}
+
+/*
+ * Sleeps until another player changes the board, or a tick at most. Taking
+ * turns, a player that moved just waits to be handed the turn again, as
+ * everybody else moves before that anyway.
+ */
+void wait_for_turn(int state, uint32_t seen)
+{
+    reap_if_due();
+    turn_pass();
+    /* After passing the turn, so the others keep playing while the file is synced. */
+    checkpoint_if_due();
+    if (state == PLAYER_WAITING || !turns_enabled())
+        wait_for_board_change(seen, state == PLAYER_WAITING ? START_WAIT_MS : TICK_MS);
+    turn_acquire();
+}
 
-        unlock_semaphore();
-        /* Not really needed but this way we will let the CPU relax a bit. */
-        usleep(10000);
+void actual_play(struct player *p)
+{
+    int state;
+
+    while ((state = player_step(p)) != PLAYER_DONE)
+    {
+        /* Players must keep moving, but someone else's move wakes us right away. */
+        wait_for_turn(state, p->seen_epoch);
     }
 }
 
-void play_game(int team)
+void play_game(int team, int agents)
 {
-    game_shm_id = shmget(SHM_GAME_KEY, sizeof(int), IPC_CREAT | 0666);
-    if (game_shm_id == -1)
+    attach_sections();
+
+    /*
+     * Each player draws from its own generator, derived from the seed, the
+     * roster slot of the process and the agent number, so a seeded run
+     * replays the same choices for every player.
+     */
+    int slot = register_player(team);
+    if (slot != -1)
     {
-        perror("shmget");
-        exit(EXIT_FAILURE);
+        player_team = team;
+        player_slot = slot;
+        turns_attach(team, slot);
     }
+    /* A game whose players all got killed is joined like a live one. */
+    reap_dead_players();
 
-    game = (struct game_state *)shmat(game_shm_id, NULL, 0);
-    if (game == (void *)-1)
+    /* Only now that we are in the game, so the trace is surely this game's. */
+    if (record_path != NULL && trace_open(record_path, arena->game_id) == -1)
     {
-        perror("shmat");
+        cleanup();
         exit(EXIT_FAILURE);
     }
+    uint64_t seed = seed_given ? game_seed : ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid();
 
-    for (int i = 0; i < MAX_TEAMS; i++)
+    /*
+     * Every agent gets a cell, or at least the ones that still fit. An
+     * adopted slot brings its pieces along, as many players as it needs.
+     */
+    lock_global(LOCK_SITE_PLACEMENT);
+    int adopted = adopted_slot ? find_owned_cells(team, owner_id, NULL, 0) : 0;
+    int wanted = adopted > agents ? adopted : agents;
+
+    players = malloc(wanted * sizeof(struct player));
+    memset(players, 0, wanted * sizeof(struct player));
+    if (adopted != 0)
     {
-        team_members[i] = (int *)(game + 1) + i * MAX_PROCESSES;
-    }
+        int found = find_owned_cells(team, owner_id, players, wanted);
 
-    lock_semaphore();
-    if (*shm_ptr == 1)
+        adopted = found < wanted ? found : wanted;
+        LOG(LOG_INFO, "Adopted %d pieces of Team %d left by a checkpoint.\n", adopted, team);
+    }
+    for (player_count = 0; player_count < wanted; player_count++)
     {
-        game->current_team = team;
-        game->current_player_pid = 0;
-        game->game_started = 0;
+        struct player *p = &players[player_count];
 
-        for (int i = 0; i < MAX_TEAMS; i++)
-        {
-            for (int j = 0; j < MAX_PROCESSES; j++)
-            {
-                team_members[i][j] = 0;
-            }
-        }
+        p->team = team;
+        p->id = player_count;
+        rng_seed(&p->rng, seed, team, slot, player_count);
+        if (player_count < adopted)
+            continue;
+        if (place_player_random(p) == -1)
+            break;
+        check_captured_enemy(p);
     }
-    unlock_semaphore();
+    unlock_global();
 
-    init_shared_matrix();
+    if (player_count == 0)
+    {
+        fprintf(stderr, "Unable to set an initial position for player...\n");
+        cleanup();
+        exit(EXIT_FAILURE);
+    }
+    if (player_count < agents)
+    {
+        fprintf(stderr, "Board full: only %d of %d agents placed.\n", player_count, agents);
+    }
 
-    lock_semaphore();
-    place_player_random(team);
-    unlock_semaphore();
+    if (bench_mode)
+        bench_begin(player_count);
 
-    actual_play(team);
+    turn_acquire();
+    if (player_count == 1)
+        actual_play(&players[0]);
+    else
+        run_agents(players, player_count, agent_threads);
 }
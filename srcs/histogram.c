@@ -0,0 +1,66 @@
+#include <time.h>
+
+#include <histogram.h>
+
+uint64_t monotonic_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int bucket_of(uint64_t ns)
+{
+    int exp;
+
+    if (ns < 16)
+        return (int)ns;
+    exp = 63 - __builtin_clzll(ns);
+    return 16 + (exp - 4) * 8 + (int)((ns >> (exp - 3)) & 7);
+}
+
+/* Lower bound of a bucket. */
+uint64_t hist_bucket_value(int bucket)
+{
+    int exp;
+
+    if (bucket < 16)
+        return (uint64_t)bucket;
+    exp = (bucket - 16) / 8 + 4;
+    return (uint64_t)(8 + (bucket - 16) % 8) << (exp - 3);
+}
+
+void hist_record(struct histogram *h, uint64_t ns)
+{
+    __atomic_fetch_add(&h->counts[bucket_of(ns)], 1, __ATOMIC_RELAXED);
+}
+
+uint64_t hist_total(const struct histogram *h)
+{
+    uint64_t total = 0;
+
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        total += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+    return total;
+}
+
+uint64_t hist_percentile(const struct histogram *h, double q)
+{
+    uint64_t total = hist_total(h);
+    uint64_t rank;
+    uint64_t seen = 0;
+
+    if (total == 0)
+        return 0;
+    rank = (uint64_t)(q * (double)total);
+    if (rank >= total)
+        rank = total - 1;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+        if (seen > rank)
+            return hist_bucket_value(i);
+    }
+    return hist_bucket_value(HIST_BUCKETS - 1);
+}
@@ -0,0 +1,447 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+
+#include <ft_malloc.h>
+#include <globals.h>
+#include <lem_ipc.h>
+#include <locks.h>
+#include <stats.h>
+#include <futex.h>
+#include <log.h>
+
+#define SEM_STRIPE_KEY 0x5679
+#define MIN_STRIPE_SIDE 4
+#define MAX_STRIPES 1024
+
+int lock_mode = LOCK_GLOBAL;
+
+static int stripe_sem_id = -1;
+static int stripe_side;
+static int stripe_cols;
+static int stripe_count;
+
+/* Spins a waiter that is next in line makes before going to sleep. */
+#define TICKET_SPINS 200
+/* How long a sleeping waiter trusts the ticket being served. */
+#define TICKET_CHECK_MS 100
+/* Checks before a served ticket nobody ever claimed counts as abandoned. */
+#define TICKET_ABANDON_CHECKS 20
+
+#define HELD_NONE 0
+#define HELD_SEMAPHORE 1
+#define HELD_TICKET 2
+/* Ticket taken, not served yet. */
+#define HELD_QUEUED 3
+
+static struct ticket_lock *global_lock = NULL;
+
+/* Hold bookkeeping is per thread: agents share the process but not locks. */
+static __thread int held = HELD_NONE;
+static __thread int held_site;
+static __thread uint64_t held_since;
+static __thread uint32_t held_ticket;
+static __thread int stripe_site;
+static __thread uint64_t stripe_since;
+/* The tiles this thread holds, so a SIGINT can give them back. */
+static __thread struct sembuf held_tiles[4];
+static __thread int held_tile_count = 0;
+
+static void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void start_hold(int kind, int site, uint64_t start)
+{
+    held_since = monotonic_ns();
+    held_site = site;
+    held = kind;
+    stats_wait(site, held_since - start);
+}
+
+static void end_hold()
+{
+    if (held == HELD_SEMAPHORE || held == HELD_TICKET)
+        stats_hold(held_site, monotonic_ns() - held_since);
+    held = HELD_NONE;
+}
+
+void lock_semaphore(int site)
+{
+    struct sembuf sop = {0, -1, SEM_UNDO};
+    uint64_t start = monotonic_ns();
+
+    while (semop(sem_id, &sop, 1) == -1)
+    {
+        if (errno == EINTR)
+            continue;
+        perror("semop lock");
+        exit(EXIT_FAILURE);
+    }
+    start_hold(HELD_SEMAPHORE, site, start);
+}
+
+void unlock_semaphore()
+{
+    struct sembuf sop = {0, 1, SEM_UNDO};
+
+    end_hold();
+    while (semop(sem_id, &sop, 1) == -1)
+    {
+        if (errno == EINTR)
+            continue;
+        perror("semop unlock");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* exit() with a ticket held or queued would leave every other player waiting. */
+static void release_at_exit()
+{
+    if (held == HELD_TICKET || held == HELD_QUEUED)
+        unlock_if_held();
+}
+
+void locks_attach(struct ticket_lock *global)
+{
+    static int registered = 0;
+
+    global_lock = global;
+    if (!registered)
+        atexit(release_at_exit);
+    registered = 1;
+}
+
+static void take_ticket()
+{
+    uint32_t ticket = __atomic_fetch_add(&global_lock->next, 1, __ATOMIC_ACQ_REL);
+
+    held_ticket = ticket;
+    held = HELD_QUEUED;
+    __atomic_store_n(&global_lock->owners[ticket % TICKET_OWNERS], ((uint64_t)ticket << 32) | (uint32_t)getpid(), __ATOMIC_RELEASE);
+}
+
+/*
+ * Moves serving past ticket, unless somebody already did, and wakes the
+ * waiter of the next one. Every release is a CAS, so a ticket skipped as
+ * abandoned can never be released twice.
+ */
+static void serve_next(uint32_t ticket)
+{
+    uint32_t expected = ticket;
+
+    if (!__atomic_compare_exchange_n(&global_lock->serving, &expected, ticket + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return;
+    if (__atomic_load_n(&global_lock->sleepers, __ATOMIC_SEQ_CST) > 0)
+        futex_wake_bitset(&global_lock->serving, INT_MAX, 1u << ((ticket + 1) % 32));
+}
+
+/*
+ * For a waiter that slept a whole TICKET_CHECK_MS on the same served
+ * ticket. Its owner is given up on once its process is dead, or if it
+ * never recorded itself in TICKET_ABANDON_CHECKS checks (it died between
+ * taking the ticket and saying so).
+ */
+static void check_served(uint32_t serving, int *checks)
+{
+    uint64_t owner = __atomic_load_n(&global_lock->owners[serving % TICKET_OWNERS], __ATOMIC_ACQUIRE);
+    int pid = (int)(uint32_t)owner;
+
+    if ((uint32_t)(owner >> 32) == serving)
+    {
+        if (pid == getpid() || !player_is_dead(pid))
+            return;
+    }
+    else if (++*checks < TICKET_ABANDON_CHECKS)
+        return;
+
+    LOG(LOG_WARN, "Skipping global lock ticket %d abandoned by process %d.\n", (int)serving, pid);
+    serve_next(serving);
+    *checks = 0;
+}
+
+/*
+ * Only the next ticket spins, as everybody further back has at least a
+ * whole hold to wait. Returns 0 if ticket got skipped as abandoned.
+ */
+static int wait_for_ticket(uint32_t ticket)
+{
+    uint32_t serving;
+    uint32_t watched = ticket;
+    int checks = 0;
+
+    for (int spins = 0; (serving = __atomic_load_n(&global_lock->serving, __ATOMIC_ACQUIRE)) != ticket; spins++)
+    {
+        if ((int32_t)(serving - ticket) > 0)
+            return 0;
+        if (ticket - serving == 1 && spins < TICKET_SPINS)
+        {
+            cpu_relax();
+            continue;
+        }
+        if (serving != watched)
+        {
+            watched = serving;
+            checks = 0;
+        }
+
+        int timed_out = 0;
+
+        __atomic_add_fetch(&global_lock->sleepers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&global_lock->serving, __ATOMIC_SEQ_CST) == serving)
+            timed_out = futex_wait_bitset(&global_lock->serving, serving, 1u << (ticket % 32), TICKET_CHECK_MS) == -1;
+        __atomic_sub_fetch(&global_lock->sleepers, 1, __ATOMIC_SEQ_CST);
+        if (timed_out)
+            check_served(serving, &checks);
+    }
+    return 1;
+}
+
+/* Uncontended, this is one atomic add, one store and one load. */
+void lock_global(int site)
+{
+    uint64_t start = monotonic_ns();
+
+    take_ticket();
+    while (!wait_for_ticket(held_ticket))
+        take_ticket();
+    start_hold(HELD_TICKET, site, start);
+}
+
+void unlock_global()
+{
+    end_hold();
+    serve_next(held_ticket);
+}
+
+int lock_phase(int site)
+{
+    int previous = held_site;
+    uint64_t now;
+
+    if (held == HELD_NONE || site == previous)
+        return previous;
+    now = monotonic_ns();
+    stats_hold(previous, now - held_since);
+    held_since = now;
+    held_site = site;
+    return previous;
+}
+
+/*
+ * For SIGINT: the interrupted code may be in the middle of a hold, and
+ * cleanup() taking the lock again would wait for itself forever.
+ */
+void unlock_if_held()
+{
+    if (held_tile_count != 0)
+    {
+        int count = held_tile_count;
+
+        held_tile_count = 0;
+        for (int i = 0; i < count; i++)
+            held_tiles[i].sem_op = 1;
+        if (semop(stripe_sem_id, held_tiles, count) == -1)
+            perror("semop stripe unlock");
+    }
+    if (held == HELD_SEMAPHORE)
+        unlock_semaphore();
+    else if (held == HELD_TICKET)
+        unlock_global();
+    else if (held == HELD_QUEUED)
+    {
+        held = HELD_NONE;
+        if (wait_for_ticket(held_ticket))
+            serve_next(held_ticket);
+    }
+}
+
+void lock_board(int site)
+{
+    if (lock_mode == LOCK_GLOBAL)
+        lock_global(site);
+}
+
+void unlock_board()
+{
+    if (lock_mode == LOCK_GLOBAL)
+        unlock_global();
+}
+
+/*
+ * Tiles are squares of stripe_side cells, numbered row-major. The side is
+ * always larger than 3 so any 3x3 area touches at most 2x2 tiles.
+ */
+static void compute_stripe_geometry()
+{
+    stripe_side = MIN_STRIPE_SIDE;
+    while (((board_width + stripe_side - 1) / stripe_side) *
+           ((board_height + stripe_side - 1) / stripe_side) > MAX_STRIPES)
+    {
+        stripe_side *= 2;
+    }
+    stripe_cols = (board_width + stripe_side - 1) / stripe_side;
+    stripe_count = stripe_cols * ((board_height + stripe_side - 1) / stripe_side);
+}
+
+/*
+ * Every tile of the rectangle goes into a single semop() in ascending index
+ * order, so two players can never wait on each other's tiles. SEM_UNDO has
+ * the kernel give back the tiles of a player killed while holding them.
+ */
+static void semop_area(int site, int top, int left, int bottom, int right, short op)
+{
+    struct sembuf sops[4];
+    int count = 0;
+    uint64_t start = monotonic_ns();
+
+    if (top < 0)
+        top = 0;
+    if (left < 0)
+        left = 0;
+    if (bottom >= board_height)
+        bottom = board_height - 1;
+    if (right >= board_width)
+        right = board_width - 1;
+
+    for (int tr = top / stripe_side; tr <= bottom / stripe_side; tr++)
+    {
+        for (int tc = left / stripe_side; tc <= right / stripe_side; tc++)
+        {
+            sops[count].sem_num = tr * stripe_cols + tc;
+            sops[count].sem_op = op;
+            sops[count].sem_flg = SEM_UNDO;
+            count++;
+        }
+    }
+
+    /* Forgotten before the release: giving tiles back twice would let two players in. */
+    if (op > 0)
+        held_tile_count = 0;
+    while (semop(stripe_sem_id, sops, count) == -1)
+    {
+        if (errno == EINTR)
+            continue;
+        perror(op < 0 ? "semop stripe lock" : "semop stripe unlock");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Tile sets never nest, so one hold per thread is enough. */
+    if (op < 0)
+    {
+        memcpy(held_tiles, sops, count * sizeof(struct sembuf));
+        held_tile_count = count;
+        stripe_since = monotonic_ns();
+        stripe_site = site;
+        stats_wait(site, stripe_since - start);
+    }
+    else
+    {
+        stats_hold(stripe_site, start - stripe_since);
+    }
+}
+
+static int min(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+static int max(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+void lock_cells(int site, int row1, int col1, int row2, int col2)
+{
+    if (lock_mode != LOCK_STRIPED)
+        return;
+    semop_area(site, min(row1, row2), min(col1, col2), max(row1, row2), max(col1, col2), -1);
+}
+
+void unlock_cells(int row1, int col1, int row2, int col2)
+{
+    if (lock_mode != LOCK_STRIPED)
+        return;
+    semop_area(stripe_site, min(row1, row2), min(col1, col2), max(row1, row2), max(col1, col2), 1);
+}
+
+void lock_area(int site, int row, int col)
+{
+    if (lock_mode != LOCK_STRIPED)
+        return;
+    semop_area(site, row - 1, col - 1, row + 1, col + 1, -1);
+}
+
+void unlock_area(int row, int col)
+{
+    if (lock_mode != LOCK_STRIPED)
+        return;
+    semop_area(stripe_site, row - 1, col - 1, row + 1, col + 1, 1);
+}
+
+/*
+ * The process creating the arena (re)creates the stripe set for its board
+ * size; the others only attach. Called from arena_attach(), with the
+ * semaphore held.
+ */
+void init_stripes(int first)
+{
+    if (lock_mode != LOCK_STRIPED)
+        return;
+
+    compute_stripe_geometry();
+
+    if (first)
+    {
+        int stale_id = semget(SEM_STRIPE_KEY, 0, 0666);
+        if (stale_id != -1)
+            semctl(stale_id, 0, IPC_RMID);
+
+        stripe_sem_id = semget(SEM_STRIPE_KEY, stripe_count, IPC_CREAT | IPC_EXCL | 0666);
+        if (stripe_sem_id == -1)
+        {
+            perror("semget (stripes)");
+            exit(EXIT_FAILURE);
+        }
+
+        unsigned short *values = malloc(stripe_count * sizeof(unsigned short));
+        for (int i = 0; i < stripe_count; i++)
+            values[i] = 1;
+        if (semctl(stripe_sem_id, 0, SETALL, values) == -1)
+        {
+            perror("semctl (stripes)");
+            exit(EXIT_FAILURE);
+        }
+        free(values);
+        if (log_level <= LOG_INFO)
+            printf("Striped locking: %d tiles of %dx%d cells.\n", stripe_count, stripe_side, stripe_side);
+    }
+    else
+    {
+        stripe_sem_id = semget(SEM_STRIPE_KEY, stripe_count, 0666);
+        if (stripe_sem_id == -1)
+        {
+            perror("semget (stripes)");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void remove_stripes()
+{
+    int id = stripe_sem_id;
+
+    if (id == -1)
+        id = semget(SEM_STRIPE_KEY, 0, 0666);
+    if (id != -1 && semctl(id, 0, IPC_RMID) == -1)
+        perror("semctl (stripes)");
+    stripe_sem_id = -1;
+}
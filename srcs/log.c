@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <log.h>
+
+#define LOG_SLOTS 4096
+#define LOG_DRAIN_MS 2
+
+int log_level = LOG_DEBUG;
+
+static const char *level_names[] = {"debug", "info", "warn", "error"};
+
+/*
+ * Bounded queue with a sequence number per slot, as the team rings: seq ==
+ * pos means free for the writer at pos, seq == pos + 1 filled for the
+ * drainer. Writers are the agents of the process, the drainer is alone.
+ */
+struct log_record
+{
+    uint64_t seq;
+    const char *fmt;
+    int level;
+    int argc;
+    int args[LOG_ARGS];
+};
+
+static struct log_record records[LOG_SLOTS];
+static uint64_t head = 0;
+static uint64_t tail = 0;
+static uint64_t dropped = 0;
+static pthread_t drainer;
+static int draining = 0;
+static int stop_draining = 0;
+
+static void print_record(const char *fmt, const int *a)
+{
+    printf(fmt, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+void log_write(int level, const char *fmt, int argc, const int *argv)
+{
+    int args[LOG_ARGS] = {0};
+
+    if (argc > LOG_ARGS)
+        argc = LOG_ARGS;
+    memcpy(args, argv, argc * sizeof(int));
+
+    if (!__atomic_load_n(&draining, __ATOMIC_ACQUIRE))
+    {
+        print_record(fmt, args);
+        return;
+    }
+
+    uint64_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    struct log_record *record;
+
+    while (1)
+    {
+        record = &records[pos % LOG_SLOTS];
+        int64_t diff = (int64_t)(__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (diff == 0 && __atomic_compare_exchange_n(&head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+        if (diff < 0)
+        {
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        if (diff > 0)
+            pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    }
+
+    record->fmt = fmt;
+    record->level = level;
+    record->argc = argc;
+    memcpy(record->args, args, sizeof(args));
+    __atomic_store_n(&record->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+static int drain()
+{
+    int printed = 0;
+
+    while (1)
+    {
+        struct log_record *record = &records[tail % LOG_SLOTS];
+
+        if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != tail + 1)
+            break;
+        print_record(record->fmt, record->args);
+        __atomic_store_n(&record->seq, tail + LOG_SLOTS, __ATOMIC_RELEASE);
+        tail++;
+        printed++;
+    }
+
+    uint64_t lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+    if (lost != 0)
+        printf("(%llu log records dropped, the log ring was full)\n", (unsigned long long)lost);
+    return printed;
+}
+
+static void *drain_main(void *arg)
+{
+    struct timespec pause = {0, LOG_DRAIN_MS * 1000000L};
+
+    (void)arg;
+    while (!__atomic_load_n(&stop_draining, __ATOMIC_ACQUIRE))
+    {
+        if (drain() == 0)
+        {
+            fflush(stdout);
+            nanosleep(&pause, NULL);
+        }
+    }
+    drain();
+    fflush(stdout);
+    return NULL;
+}
+
+void log_start()
+{
+    sigset_t block;
+    sigset_t old;
+
+    for (uint64_t i = 0; i < LOG_SLOTS; i++)
+        records[i].seq = i;
+
+    /* SIGINT runs cleanup(), which joins the drainer: it must not land there. */
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    if (pthread_create(&drainer, NULL, drain_main, NULL) != 0)
+        perror("pthread_create (log)");
+    else
+        __atomic_store_n(&draining, 1, __ATOMIC_RELEASE);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+void log_stop()
+{
+    if (!__atomic_load_n(&draining, __ATOMIC_ACQUIRE))
+        return;
+
+    __atomic_store_n(&stop_draining, 1, __ATOMIC_RELEASE);
+    pthread_join(drainer, NULL);
+    __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+}
+
+int log_parse_level(const char *name)
+{
+    for (int i = LOG_DEBUG; i <= LOG_ERROR; i++)
+    {
+        if (strcmp(name, level_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
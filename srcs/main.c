@@ -5,99 +5,100 @@
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <sys/sem.h>
-#include <sys/msg.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 
 #include <ft_malloc.h>
 #include <lem_ipc.h>
 #include <globals.h>
-
-#define SHM_KEY 0x1234
-#define SEM_KEY 0x5678
-#define MSG_KEY_BASE 0x9ABC
-
-int shm_id, sem_id;
+#include <locks.h>
+#include <bench.h>
+#include <stats.h>
+#include <segment.h>
+#include <arena.h>
+#include <ring.h>
+#include <broadcast.h>
+#include <planner.h>
+#include <log.h>
+#include <trace.h>
+#include <checkpoint.h>
+
+int sem_id;
 int *shm_ptr = NULL;
-int msg_ids[MAX_TEAMS] = {0};
+int board_width = DEFAULT_WIDTH;
+int board_height = DEFAULT_HEIGHT;
+int render_board = 0;
+int verify_captures = 0;
+int agent_threads = 0;
+int seed_given = 0;
+unsigned int game_seed = 0;
+int bench_mode = 0;
+int max_ticks = 0;
+int team_planning = 1;
+int shm_backend = BACKEND_SYSV;
+int use_hugepages = 0;
+char backing_dir[BACKING_DIR_MAX] = DEFAULT_BACKING_DIR;
+const char *record_path = NULL;
+const char *checkpoint_path = NULL;
+const char *resume_path = NULL;
+int checkpoint_seconds = DEFAULT_CHECKPOINT_SECONDS;
 static int team = 0;
+static int broadcast_sub = -1;
 
 
-struct message
-{
-    long mtype;
-    char mtext[128];
-};
-
-static void lock_semaphore()
-{
-    struct sembuf sop = {0, -1, 0};
-    if (semop(sem_id, &sop, 1) == -1)
-    {
-        perror("semop lock");
-        exit(EXIT_FAILURE);
-    }
-}
-
-static void unlock_semaphore()
-{
-    struct sembuf sop = {0, 1, 0};
-    if (semop(sem_id, &sop, 1) == -1)
-    {
-        perror("semop unlock");
-        exit(EXIT_FAILURE);
-    }
-}
-
 void cleanup()
 {
-    lock_semaphore();
+    /* Whatever the agents logged comes out before the report and goodbyes. */
+    log_stop();
+    bench_report(team);
+
+    lock_semaphore(LOCK_SITE_CLEANUP);
 
     if (*shm_ptr == 1)
     {
-        printf("\nLast process: Cleaning up resources.\n");
-        
-        if (shmctl(shm_id, IPC_RMID, NULL) == -1)
-        {
-            perror("shmctl (game)");
-        }
+        LOG(LOG_INFO, "\nLast process: Cleaning up resources.\n");
+        /* The board outlives the game in the checkpoint, if we keep one. */
+        if (checkpoint_path != NULL && checkpoint_write() == -1)
+            fprintf(stderr, "Final checkpoint skipped: the board was being changed.\n");
+        *shm_ptr = 0;
 
         if (semctl(sem_id, 0, IPC_RMID) == -1)
         {
             perror("semctl");
         }
 
-        for (int i = 0; i < MAX_TEAMS; i++)
+        remove_stripes();
+
+        if (arena_remove() == -1)
         {
-            if (msg_ids[i] != 0)
-            {
-                if (msgctl(msg_ids[i], IPC_RMID, NULL) == -1)
-                {
-                    perror("msgctl");
-                }
-            }
+            perror("arena remove");
         }
 
-        cleanup_shared_matrix();
-
-        printf("All resources cleaned up.\n");
+        LOG(LOG_INFO, "All resources cleaned up.\n");
     }
     else
     {
-        (*shm_ptr)--;
-        printf("\nDetached. Remaining processes: %d\n", *shm_ptr);
+        __atomic_sub_fetch(shm_ptr, 1, __ATOMIC_ACQ_REL);
+        LOG(LOG_INFO, "\nDetached. Remaining processes: %d\n", *shm_ptr);
 
         unlock_semaphore();
-        restore_player_position(team);
-        lock_semaphore();
+        restore_players();
+        lock_semaphore(LOCK_SITE_CLEANUP);
     }
 
-    if (shmdt(shm_ptr) == -1)
+    unregister_player();
+
+    if (broadcast_sub != -1)
     {
-        perror("shmdt (game)");
+        broadcast_unsubscribe(ARENA_SECTION(struct broadcast_log, broadcasts) + team, broadcast_sub);
     }
 
-    // detach_matrix();
+    trace_close();
+
+    /* Lock timings must stop going to the arena before it is unmapped. */
+    stats_attach(NULL);
+    arena_detach();
 
     unlock_semaphore();
     exit(0);
@@ -107,101 +108,118 @@ void cleanup()
 void force_cleanup()
 {
     printf("Force cleaning up all shared resources.\n");
-    cleanup_shared_matrix();
-    if (shm_id != -1)
-        shmctl(shm_id, IPC_RMID, NULL);
-    if (sem_id != -1)
-        semctl(sem_id, 0, IPC_RMID);
-    for (int i = 0; i < MAX_TEAMS; i++)
+    if (checkpoint_path != NULL && arena_attach_read_only())
     {
-        if (msg_ids[i] != 0)
-        {
-            msgctl(msg_ids[i], IPC_RMID, NULL);
-        }
+        if (checkpoint_write() == -1)
+            fprintf(stderr, "Checkpoint skipped: the board kept changing.\n");
+        arena_detach();
     }
+    remove_stripes();
+    if (segment_find(SHM_ARENA_KEY, ARENA_NAME) != -1)
+        arena_remove();
+    if (sem_id != -1)
+        semctl(sem_id, 0, IPC_RMID);
     exit(0);
 }
 
 void handle_sigint(int sig)
 {
     (void)sig;
+    unlock_if_held();
     cleanup();
     exit(0);
 }
 
-int initialize_msg_queues()
-{
-    for (int i = 0; i < MAX_TEAMS; i++)
-    {
-        msg_ids[i] = msgget(MSG_KEY_BASE + i, IPC_CREAT | 0666);
-        if (msg_ids[i] == -1)
-        {
-            perror("msgget");
-            return -1;
-        }
-    }
-    return 0;
-}
-
-void send_message(int team, const char *message, long mtype)
+static struct ring *team_ring(int team)
 {
     if (team < 0 || team >= MAX_TEAMS)
     {
         fprintf(stderr, "Invalid team number.\n");
-        return;
+        return NULL;
     }
+    return ARENA_SECTION(struct ring, rings) + team;
+}
 
-    struct message msg;
-    msg.mtype = mtype;
-    strncpy(msg.mtext, message, sizeof(msg.mtext));
+void send_message(int team, const char *message, int type)
+{
+    struct ring *ring = team_ring(team);
 
-    if (msgsnd(msg_ids[team], &msg, sizeof(msg.mtext), 0) == -1)
+    if (ring != NULL && ring_send(ring, type, message) == -1)
     {
-        perror("msgsnd");
+        fprintf(stderr, "Team %d mailbox full, message dropped.\n", team);
     }
 }
 
-void broadcast_message(int team, const char *message)
+static struct broadcast_log *team_log(int team)
 {
     if (team < 0 || team >= MAX_TEAMS)
     {
         fprintf(stderr, "Invalid team number.\n");
-        return;
+        return NULL;
     }
+    return ARENA_SECTION(struct broadcast_log, broadcasts) + team;
+}
 
-    struct message msg;
-    strncpy(msg.mtext, message, sizeof(msg.mtext));
+/* Written once to the team's log, whatever the number of members reading it. */
+void broadcast_message(int team, const char *message)
+{
+    struct broadcast_log *log = team_log(team);
 
-    for (int i = 0; i < MAX_TEAMS; i++)
+    if (log != NULL && broadcast_publish(log, message) == -1)
     {
-        msg.mtype = i + 1; // Use process-specific mtype
-        if (msgsnd(msg_ids[team], &msg, sizeof(msg.mtext), 0) == -1)
-        {
-            perror("msgsnd (broadcast)");
-        }
+        fprintf(stderr, "Team %d broadcast log full, broadcast dropped.\n", team);
     }
 }
 
-void receive_message(int team, long mtype)
+/*
+ * Reads every broadcast of our team this process has not read yet: plans go
+ * to the planner, anything else is printed.
+ */
+void receive_broadcasts()
 {
-    if (team < 0 || team >= MAX_TEAMS)
-    {
-        fprintf(stderr, "Invalid team number.\n");
+    struct broadcast_log *log = team_log(team);
+    const struct broadcast_entry *entry;
+    char text[BROADCAST_TEXT];
+    uint64_t lost = 0;
+
+    if (log == NULL || broadcast_sub == -1)
         return;
-    }
 
-    struct message msg;
-    if (msgrcv(msg_ids[team], &msg, sizeof(msg.mtext), mtype, IPC_NOWAIT) == -1)
+    while ((entry = broadcast_next(log, broadcast_sub, &lost)) != NULL || lost != 0)
     {
-        if (errno != ENOMSG)
+        if (lost != 0)
         {
-            perror("msgrcv");
+            LOG(LOG_WARN, "Missed %d broadcasts to team %d.\n", (int)lost, team);
+            lost = 0;
+            continue;
         }
+        snprintf(text, sizeof(text), "%.*s", entry->len, entry->text);
+        if (broadcast_done(log, broadcast_sub, entry) == -1)
+            LOG(LOG_WARN, "Broadcast to team %d overwritten while reading.\n", team);
+        else if (!planner_receive(text) && log_level <= LOG_INFO)
+            printf("Broadcast to team %d: %s\n", team, text);
     }
-    else
-    {
-        printf("Received from team %d: %s\n", team, msg.mtext);
-    }
+}
+
+/* Our subscription to the team broadcasts, given back for us if we die. */
+int team_subscription()
+{
+    return broadcast_sub;
+}
+
+/* Reads the message where it sits in the ring, then hands the slot back. */
+void receive_message(int team, int type)
+{
+    struct ring *ring = team_ring(team);
+    struct ring_slot *slot;
+    uint64_t pos;
+
+    if (ring == NULL || (slot = ring_receive(ring, type, &pos)) == NULL)
+        return;
+
+    if (log_level <= LOG_INFO)
+        printf("Received from team %d: %.*s\n", team, slot->len, slot->text);
+    ring_release(slot, pos);
 }
 
 void get_team_number(char *s, int *team)
@@ -226,20 +244,6 @@ error:
 
 void init()
 {
-    shm_id = shmget(SHM_KEY, sizeof(int), IPC_CREAT | 0666);
-    if (shm_id == -1)
-    {
-        perror("shmget");
-        exit(EXIT_FAILURE);
-    }
-
-    shm_ptr = (int *)shmat(shm_id, NULL, 0);
-    if (shm_ptr == (void *)-1)
-    {
-        perror("shmat");
-        exit(EXIT_FAILURE);
-    }
-
     sem_id = semget(SEM_KEY, 1, IPC_CREAT | 0666);
     if (sem_id == -1)
     {
@@ -251,66 +255,208 @@ void init()
     {
         semctl(sem_id, 0, SETVAL, 1);
     }
+}
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--clean] [--observe [--fps N]] [--stats [--watch]] [--width N] [--height N] [--striped | --lockfree] [--backend sysv|posix|file [--backing-dir DIR]] [--hugepages] [--render] [--verify-captures] [--agents N [--threads N]] [--seed N] [--no-plan] [--record FILE | --replay FILE [--render] [--fps N]] [--checkpoint FILE [--every SECONDS]] [--resume FILE] [--quiet | --log-level debug|info|warn|error] [--bench] [--ticks N] [team]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+/* Joiners may run from anywhere, so the first process stores an absolute path. */
+static void set_backing_dir(const char *dir)
+{
+    char resolved[PATH_MAX];
 
-    if (initialize_msg_queues() == -1)
+    if (realpath(dir, resolved) == NULL)
     {
-        cleanup();
+        perror(dir);
+        exit(EXIT_FAILURE);
+    }
+    if (strlen(resolved) >= BACKING_DIR_MAX)
+    {
+        fprintf(stderr, "Backing directory '%s' is too long.\n", resolved);
+        exit(EXIT_FAILURE);
     }
+    strcpy(backing_dir, resolved);
 }
 
-
-int main(int argc, char *argv[])
+static int parse_number(const char *s, const char *name, int min, int max)
 {
-    if (argc < 2 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0)
+    char *end;
+    long value;
+
+    errno = 0;
+    value = strtol(s, &end, 10);
+    if (errno != 0 || end == s || *end != '\0' || value < min || value > max)
     {
-        fprintf(stderr, "Usage: %s [--clean] [team]\n", argv[0]);
+        fprintf(stderr, "Invalid %s '%s'. Valids are [%d - %d]\n", name, s, min, max);
         exit(EXIT_FAILURE);
     }
+    return (int)value;
+}
+
+static void clean_resources()
+{
+    int found = segment_find(SHM_ARENA_KEY, ARENA_NAME) != -1;
+
+    sem_id = semget(SEM_KEY, 1, 0666);
 
-    if ((strcmp(argv[1], "--clean") == 0 ) || (strcmp(argv[1], "-c") == 0))
+    if (!found)
     {
-        shm_id = shmget(SHM_KEY, sizeof(int), 0666);
-        sem_id = semget(SEM_KEY, 1, 0666);
-        for (int i = 0; i < MAX_TEAMS; i++)
+        fprintf(stderr, "Shared memory not found.\n");
+    }
+    if (sem_id == -1)
+    {
+        fprintf(stderr, "Semaphore not found.\n");
+    }
+
+    force_cleanup();
+}
+
+int main(int argc, char *argv[])
+{
+    char *team_arg = NULL;
+    int observe_mode = 0;
+    int stats_mode = 0;
+    int watch = 0;
+    int fps = DEFAULT_FPS;
+    int agents = 1;
+    const char *replay_path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
+            usage(argv[0]);
+        else if (strcmp(argv[i], "--clean") == 0 || strcmp(argv[i], "-c") == 0)
+            clean_resources();
+        else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+            board_width = parse_number(argv[++i], "width", 1, MAX_BOARD_SIDE);
+        else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+            board_height = parse_number(argv[++i], "height", 1, MAX_BOARD_SIDE);
+        else if (strcmp(argv[i], "--striped") == 0)
+            lock_mode = LOCK_STRIPED;
+        else if (strcmp(argv[i], "--lockfree") == 0)
+            lock_mode = LOCK_FREE;
+        else if (strcmp(argv[i], "--observe") == 0)
+            observe_mode = 1;
+        else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc)
         {
-            msg_ids[i] = msgget(MSG_KEY_BASE + i, 0666);
+            shm_backend = parse_backend(argv[++i]);
+            if (shm_backend == -1)
+            {
+                fprintf(stderr, "Invalid backend '%s'. Valids are sysv, posix and file\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
         }
-
-        if (shm_id == -1)
+        else if (strcmp(argv[i], "--backing-dir") == 0 && i + 1 < argc)
+            set_backing_dir(argv[++i]);
+        else if (strcmp(argv[i], "--hugepages") == 0)
+            use_hugepages = 1;
+        else if (strcmp(argv[i], "--stats") == 0)
+            stats_mode = 1;
+        else if (strcmp(argv[i], "--watch") == 0)
+            watch = 1;
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+            fps = parse_number(argv[++i], "fps", 1, 1000);
+        else if (strcmp(argv[i], "--render") == 0)
+            render_board = 1;
+        else if (strcmp(argv[i], "--verify-captures") == 0)
+            verify_captures = 1;
+        else if (strcmp(argv[i], "--agents") == 0 && i + 1 < argc)
+            agents = parse_number(argv[++i], "agents", 1, MAX_AGENTS);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
         {
-            fprintf(stderr, "Shared memory not found.\n");
+            game_seed = parse_number(argv[++i], "seed", 0, INT_MAX);
+            seed_given = 1;
         }
-        if (sem_id == -1)
+        else if (strcmp(argv[i], "--no-plan") == 0)
+            team_planning = 0;
+        else if (strcmp(argv[i], "--quiet") == 0 || strcmp(argv[i], "-q") == 0)
+            log_level = LOG_WARN;
+        else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc)
         {
-            fprintf(stderr, "Semaphore not found.\n");
+            log_level = log_parse_level(argv[++i]);
+            if (log_level == -1)
+            {
+                fprintf(stderr, "Invalid log level '%s'. Valids are debug, info, warn and error\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
         }
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+            checkpoint_path = argv[++i];
+        else if (strcmp(argv[i], "--every") == 0 && i + 1 < argc)
+            checkpoint_seconds = parse_number(argv[++i], "checkpoint interval", 1, INT_MAX);
+        else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc)
+            resume_path = argv[++i];
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replay_path = argv[++i];
+        else if (strcmp(argv[i], "--bench") == 0)
+            bench_mode = 1;
+        else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+            max_ticks = parse_number(argv[++i], "ticks", 1, INT_MAX);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            agent_threads = parse_number(argv[++i], "threads", 1, MAX_AGENT_THREADS);
+        else if (team_arg == NULL && argv[i][0] != '-')
+            team_arg = argv[i];
+        else
+            usage(argv[0]);
+    }
+
+    if (observe_mode)
+    {
+        observe(fps);
+        return 0;
+    }
 
-        force_cleanup();
+    if (replay_path != NULL)
+    {
+        trace_replay(replay_path, fps);
+        return 0;
     }
 
-    get_team_number(argv[1], &team);
+    if (stats_mode)
+    {
+        show_stats(watch);
+        return 0;
+    }
+
+    if (team_arg == NULL)
+        usage(argv[0]);
+
+    get_team_number(team_arg, &team);
 
     signal(SIGINT, handle_sigint);
+    signal(SIGUSR1, checkpoint_request);
+    log_start();
 
     init();
 
-    lock_semaphore();
+    lock_semaphore(LOCK_SITE_JOIN);
+
+    arena_attach();
+    shm_ptr = &ARENA_SECTION(struct game_state, game)->processes;
+    stats_attach(ARENA_SECTION(struct lock_stats, stats));
+    broadcast_sub = broadcast_subscribe(team_log(team));
 
     /* trash */
     if (*shm_ptr == 0)
     {
-        printf("First process: Initializing shared resources.\n");
+        LOG(LOG_INFO, "First process: Initializing shared resources.\n");
     }
     /* trash */
 
-    (*shm_ptr)++;
+    __atomic_add_fetch(shm_ptr, 1, __ATOMIC_ACQ_REL);
     /* trash */
-    printf("Attached. Total processes: %d\n", *shm_ptr);
+    LOG(LOG_INFO, "Attached. Total processes: %d\n", *shm_ptr);
     /* trash */
     unlock_semaphore();
 
     /* trash */
-    printf("Joined team %d\n", team);
+    LOG(LOG_INFO, "Joined team %d\n", team);
     /* trash */
 
     /* trash */
@@ -319,9 +465,9 @@ int main(int argc, char *argv[])
     send_message(team, join_message, 1);
     /* trash */
 
-    printf("Joining team %d\n", team);
+    LOG(LOG_INFO, "Joining team %d\n", team);
 
-    play_game(team);
+    play_game(team, agents);
 
     cleanup();
 
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <ft_malloc.h>
+#include <globals.h>
+#include <lem_ipc.h>
+
+#define SNAPSHOT_RETRIES 8
+
+static volatile sig_atomic_t stop_observing = 0;
+
+static void handle_observer_sigint(int sig)
+{
+    (void)sig;
+    stop_observing = 1;
+}
+
+/*
+ * Copies the matrix without taking any lock. The copy is kept only if no
+ * player was in the middle of a change and the epoch did not move while
+ * copying. Under heavy traffic we give up after a few tries rather than
+ * starve: the last try copies whatever is there, so a frame may rarely be
+ * torn but is never left unfilled.
+ */
+static uint32_t take_snapshot(const struct game_state *game, const int *matrix, int *snapshot, size_t size)
+{
+    uint32_t before = 0;
+    uint32_t after = 0;
+
+    for (int i = 0; i < SNAPSHOT_RETRIES; i++)
+    {
+        if (__atomic_load_n(&game->board_writers, __ATOMIC_SEQ_CST) != 0 && i < SNAPSHOT_RETRIES - 1)
+            continue;
+        before = __atomic_load_n(&game->epoch, __ATOMIC_SEQ_CST);
+
+        memcpy(snapshot, matrix, size);
+
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        after = __atomic_load_n(&game->epoch, __ATOMIC_SEQ_CST);
+        if (before == after && __atomic_load_n(&game->board_writers, __ATOMIC_SEQ_CST) == 0)
+            break;
+    }
+    return after;
+}
+
+/* The last player sets the process count to zero on its way out. */
+static int game_is_over(const struct game_state *game)
+{
+    return __atomic_load_n(&game->processes, __ATOMIC_ACQUIRE) == 0;
+}
+
+void observe(int fps)
+{
+    if (!arena_attach_read_only())
+    {
+        fprintf(stderr, "No game running.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const struct game_state *game = ARENA_SECTION(struct game_state, game);
+    board_width = arena->width;
+    board_height = arena->height;
+
+    const int *matrix = ARENA_SECTION(int, matrix);
+    size_t size = (size_t)board_width * board_height * sizeof(int);
+    int *snapshot = malloc(size);
+    uint32_t rendered = __atomic_load_n(&game->epoch, __ATOMIC_SEQ_CST) - 1;
+
+    signal(SIGINT, handle_observer_sigint);
+
+    while (!stop_observing && !game_is_over(game))
+    {
+        if (__atomic_load_n(&game->epoch, __ATOMIC_SEQ_CST) != rendered)
+        {
+            rendered = take_snapshot(game, matrix, snapshot, size);
+            print_matrix(snapshot);
+        }
+        usleep(1000000 / fps);
+    }
+
+    printf("Observer detached.\n");
+    free(snapshot);
+    arena_detach();
+}
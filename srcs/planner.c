@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <globals.h>
+#include <lem_ipc.h>
+#include <spatial.h>
+#include <planner.h>
+#include <log.h>
+
+/* Board changes between two plans of the same team. */
+#define PLAN_INTERVAL 8
+/* Steps an assignment outlives the walk to its flank cell. */
+#define PLAN_SLACK 8
+
+#define PLAN_FORMAT "plan %u: Team %d at [%d, %d], [%d, %d] -> [%d, %d], [%d, %d] -> [%d, %d]"
+
+/*
+ * A plan sends two pieces of a team, named by the cell they stood on when it
+ * was made, to opposite sides of one enemy so the second arrival captures it.
+ * Its id is the board epoch it was made at.
+ */
+struct plan
+{
+    uint32_t id;
+    int target_team;
+    int target[2];
+    int from[2][2];
+    int flank[2][2];
+};
+
+/* The axes is_piece_surrounded() checks. */
+static const int flank_axes[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+
+static struct game_state *game = NULL;
+static int *matrix = NULL;
+
+/*
+ * Latest plan of our team this process read. One agent at a time drains the
+ * team broadcasts under poll_lock, the others copy the plan under a sequence
+ * count, so no agent ever waits for another one.
+ */
+static pthread_mutex_t poll_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct plan latest;
+static uint32_t latest_version = 0;
+
+void planner_attach(struct game_state *shared_game, int *shared_matrix)
+{
+    game = shared_game;
+    matrix = shared_matrix;
+}
+
+static int distance(int r1, int c1, int r2, int c2)
+{
+    return abs(r1 - r2) + abs(c1 - c2);
+}
+
+/* A flank cell is worth heading for if it is free, or already ours. */
+static int open_cell(int row, int col, const struct player *p)
+{
+    if (row < 0 || row >= board_height || col < 0 || col >= board_width)
+        return 0;
+
+    int value = __atomic_load_n(&matrix[row * board_width + col], __ATOMIC_RELAXED);
+    return value == 0 || value == p->team;
+}
+
+int planner_receive(const char *text)
+{
+    struct plan plan;
+
+    if (sscanf(text, PLAN_FORMAT, &plan.id, &plan.target_team, &plan.target[0], &plan.target[1],
+               &plan.from[0][0], &plan.from[0][1], &plan.flank[0][0], &plan.flank[0][1],
+               &plan.from[1][0], &plan.from[1][1], &plan.flank[1][0], &plan.flank[1][1]) != 12)
+        return 0;
+
+    __atomic_store_n(&latest_version, latest_version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    latest = plan;
+    __atomic_store_n(&latest_version, latest_version + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* 0 while this process has not read any plan yet. */
+static int read_latest(struct plan *plan)
+{
+    uint32_t version;
+
+    do
+    {
+        version = __atomic_load_n(&latest_version, __ATOMIC_ACQUIRE);
+        *plan = latest;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((version & 1) || version != __atomic_load_n(&latest_version, __ATOMIC_RELAXED));
+
+    return version != 0;
+}
+
+static void poll_plans()
+{
+    if (pthread_mutex_trylock(&poll_lock) != 0)
+        return;
+    receive_broadcasts();
+    pthread_mutex_unlock(&poll_lock);
+}
+
+static void assign(struct player *p, const struct plan *plan, int side)
+{
+    p->goal[0] = plan->flank[side][0];
+    p->goal[1] = plan->flank[side][1];
+    p->target[0] = plan->target[0];
+    p->target[1] = plan->target[1];
+    p->target_team = plan->target_team;
+    p->goal_ttl = distance(p->position[0], p->position[1], p->goal[0], p->goal[1]) + PLAN_SLACK;
+}
+
+/* Takes our side of a new plan if it names the cell we are on. */
+static void adopt_plan(struct player *p)
+{
+    struct plan plan;
+
+    if (!read_latest(&plan) || plan.id == p->plan_seen)
+        return;
+
+    p->plan_seen = plan.id;
+    for (int side = 0; side < 2; side++)
+    {
+        if (plan.from[side][0] == p->position[0] && plan.from[side][1] == p->position[1])
+        {
+            assign(p, &plan, side);
+            return;
+        }
+    }
+}
+
+/*
+ * Pieces move one square a step, so a target that left its cell is looked
+ * for next to it, and both flank cells shift with it. -1 once it is gone.
+ */
+static int track_target(struct player *p)
+{
+    static const int moves[5][2] = {{0, 0}, {-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+
+    for (int i = 0; i < 5; i++)
+    {
+        int r = p->target[0] + moves[i][0];
+        int c = p->target[1] + moves[i][1];
+
+        if (r < 0 || r >= board_height || c < 0 || c >= board_width)
+            continue;
+        if (__atomic_load_n(&matrix[r * board_width + c], __ATOMIC_RELAXED) != p->target_team)
+            continue;
+
+        p->target[0] = r;
+        p->target[1] = c;
+        p->goal[0] += moves[i][0];
+        p->goal[1] += moves[i][1];
+        return 1;
+    }
+    return -1;
+}
+
+/* An assignment ends once its target is gone or someone is on its flank. */
+static int keep_goal(struct player *p)
+{
+    if (track_target(p) == -1 || !open_cell(p->goal[0], p->goal[1], p))
+        return 0;
+
+    /* A teammate that got there first does our half of the job. */
+    if (p->goal[0] == p->position[0] && p->goal[1] == p->position[1])
+        return 1;
+    return __atomic_load_n(&matrix[p->goal[0] * board_width + p->goal[1]], __ATOMIC_RELAXED) == 0;
+}
+
+/*
+ * Picks the enemy closest to p and the pair of opposite cells around it
+ * that p and its nearest teammate reach in the fewest moves together. Only
+ * one player per team plans every PLAN_INTERVAL board changes: whoever wins
+ * the CAS on the team's plan epoch.
+ */
+static void make_plan(struct player *p)
+{
+    uint32_t now = board_epoch();
+    uint32_t last = __atomic_load_n(&game->plan_epoch[p->team], __ATOMIC_ACQUIRE);
+    struct plan plan;
+    int best = -1;
+    int tr, tc;
+
+    if (now - last < PLAN_INTERVAL)
+        return;
+    if (spatial_nearest_enemy(p->position[0], p->position[1], p->team, &tr, &tc) == -1)
+        return;
+
+    plan.target_team = __atomic_load_n(&matrix[tr * board_width + tc], __ATOMIC_RELAXED);
+    for (int axis = 0; axis < 4; axis++)
+    {
+        int ends[2][2] = {
+            {tr - flank_axes[axis][0], tc - flank_axes[axis][1]},
+            {tr + flank_axes[axis][0], tc + flank_axes[axis][1]}};
+
+        if (!open_cell(ends[0][0], ends[0][1], p) || !open_cell(ends[1][0], ends[1][1], p))
+            continue;
+
+        for (int mine = 0; mine < 2; mine++)
+        {
+            int *other = ends[1 - mine];
+            int ar, ac;
+
+            if (spatial_nearest_ally(other[0], other[1], p->team, p->position[0], p->position[1], &ar, &ac) == -1)
+                return;
+
+            int cost = distance(p->position[0], p->position[1], ends[mine][0], ends[mine][1]) +
+                       distance(ar, ac, other[0], other[1]);
+            if (best != -1 && cost >= best)
+                continue;
+
+            best = cost;
+            plan.from[0][0] = p->position[0];
+            plan.from[0][1] = p->position[1];
+            plan.flank[0][0] = ends[mine][0];
+            plan.flank[0][1] = ends[mine][1];
+            plan.from[1][0] = ar;
+            plan.from[1][1] = ac;
+            plan.flank[1][0] = other[0];
+            plan.flank[1][1] = other[1];
+        }
+    }
+
+    if (best == -1 || !__atomic_compare_exchange_n(&game->plan_epoch[p->team], &last, now, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return;
+
+    char text[128];
+
+    plan.id = now;
+    plan.target[0] = tr;
+    plan.target[1] = tc;
+    snprintf(text, sizeof(text), PLAN_FORMAT, plan.id, plan.target_team, tr, tc,
+             plan.from[0][0], plan.from[0][1], plan.flank[0][0], plan.flank[0][1],
+             plan.from[1][0], plan.from[1][1], plan.flank[1][0], plan.flank[1][1]);
+    broadcast_message(p->team, text);
+    LOG(LOG_INFO, "Player %d from Team %d sent plan %d: Team %d at [%d, %d]\n", getpid(), p->team, (int)plan.id, plan.target_team, tr, tc);
+
+    assign(p, &plan, 0);
+    p->plan_seen = plan.id;
+}
+
+int planner_goal(struct player *p, int *goal_row, int *goal_col)
+{
+    poll_plans();
+    adopt_plan(p);
+
+    if (p->goal_ttl > 0 && !keep_goal(p))
+        p->goal_ttl = 0;
+
+    if (p->goal_ttl == 0)
+        make_plan(p);
+    if (p->goal_ttl == 0)
+        return -1;
+
+    p->goal_ttl--;
+    *goal_row = p->goal[0];
+    *goal_col = p->goal[1];
+    return 1;
+}
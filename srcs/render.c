@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+
+#include <ft_malloc.h>
+#include <globals.h>
+#include <lem_ipc.h>
+
+/* First board line on screen (1 based), below the "Game Board:" title. */
+#define BOARD_TOP 2
+/* Worst case per cell: a cursor move plus a coloured glyph. */
+#define MAX_CELL_BYTES 32
+
+static const char *const cell_glyphs[MAX_TEAMS] = {
+    ". ",
+    "\033[31m1 \033[0m", // Team 1 (red)
+    "\033[34m2 \033[0m", // Team 2 (blue)
+    "\033[32m3 \033[0m", // Team 3 (green)
+    "\033[33m4 \033[0m", // Team 4 (yellow)
+    "\033[35m5 \033[0m", // Team 5 (purple)
+    "\033[36m6 \033[0m", // Team 6 (cyan)
+    "\033[37m7 \033[0m", // Team 7 (white)
+    "\033[91m8 \033[0m", // Team 8 (light red)
+    "\033[94m9 \033[0m", // Team 9 (light blue)
+};
+
+static int *previous = NULL;
+static int previous_rows;
+static int previous_cols;
+static char *frame = NULL;
+static size_t frame_size;
+static size_t frame_len;
+
+static void append(const char *s, size_t len)
+{
+    memcpy(frame + frame_len, s, len);
+    frame_len += len;
+}
+
+static void append_str(const char *s)
+{
+    append(s, strlen(s));
+}
+
+static void append_cursor(int row, int col)
+{
+    frame_len += snprintf(frame + frame_len, frame_size - frame_len, "\033[%d;%dH", row, col);
+}
+
+static void append_cell(int value)
+{
+    append_str(value >= 0 && value < MAX_TEAMS ? cell_glyphs[value] : "? ");
+}
+
+static void flush_frame()
+{
+    size_t done = 0;
+
+    /* Anything printf()'d before must reach the terminal before our frame. */
+    fflush(stdout);
+    while (done < frame_len)
+    {
+        ssize_t ret = write(STDOUT_FILENO, frame + done, frame_len - done);
+        if (ret == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("write (render)");
+            break;
+        }
+        done += ret;
+    }
+}
+
+/* Only the part of the board that fits in the terminal is drawn. */
+static void visible_area(int *rows, int *cols, int *term_rows)
+{
+    struct winsize ws;
+
+    *rows = board_height;
+    *cols = board_width;
+    *term_rows = 0;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > BOARD_TOP && ws.ws_col > 1)
+    {
+        *term_rows = ws.ws_row;
+        if (*rows > ws.ws_row - BOARD_TOP)
+            *rows = ws.ws_row - BOARD_TOP;
+        if (*cols > ws.ws_col / 2)
+            *cols = ws.ws_col / 2;
+    }
+}
+
+/*
+ * Draws the board keeping the last frame around: only cells that changed
+ * since then are sent, each behind a cursor move unless it directly follows
+ * the previous one. The whole frame goes out in a single write().
+ *
+ * Text printed between frames scrolls in a region below the board, so the
+ * board itself never moves and the cursor is given back where it was.
+ */
+void print_matrix(const int *cells)
+{
+    int rows;
+    int cols;
+    int term_rows;
+    int redraw;
+
+    visible_area(&rows, &cols, &term_rows);
+    redraw = previous == NULL || rows != previous_rows || cols != previous_cols;
+
+    if (frame == NULL || frame_size < (size_t)rows * cols * MAX_CELL_BYTES + 64)
+    {
+        free(frame);
+        frame_size = (size_t)rows * cols * MAX_CELL_BYTES + 64;
+        frame = malloc(frame_size);
+    }
+    if (redraw)
+    {
+        free(previous);
+        previous = malloc((size_t)rows * cols * sizeof(int));
+        previous_rows = rows;
+        previous_cols = cols;
+    }
+
+    frame_len = 0;
+    if (redraw)
+    {
+        append_str("\033[r\033[H\033[JGame Board:\n");
+        if (term_rows > BOARD_TOP + rows)
+            frame_len += snprintf(frame + frame_len, frame_size - frame_len, "\033[%d;%dr", BOARD_TOP + rows, term_rows);
+    }
+    else
+        append_str("\0337");
+
+    for (int r = 0; r < rows; r++)
+    {
+        int cursor_col = -1;
+
+        for (int c = 0; c < cols; c++)
+        {
+            int value = cells[r * board_width + c];
+            int *seen = &previous[r * cols + c];
+
+            if (!redraw && *seen == value)
+                continue;
+            if (cursor_col != c)
+                append_cursor(BOARD_TOP + r, c * 2 + 1);
+            append_cell(value);
+            cursor_col = c + 1;
+            *seen = value;
+        }
+    }
+
+    if (redraw)
+        append_cursor(BOARD_TOP + rows, 1);
+    else
+        append_str("\0338");
+    flush_frame();
+}
@@ -0,0 +1,75 @@
+#include <string.h>
+
+#include <ring.h>
+
+void ring_init(struct ring *ring)
+{
+    ring->head = 0;
+    ring->tail = 0;
+    for (uint64_t i = 0; i < RING_SLOTS; i++)
+        ring->slots[i].seq = i;
+}
+
+int ring_send(struct ring *ring, int type, const char *text)
+{
+    uint64_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    struct ring_slot *slot;
+
+    while (1)
+    {
+        slot = &ring->slots[pos % RING_SLOTS];
+        int64_t diff = (int64_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+        /* Still holding the message from one lap ago. */
+        if (diff < 0)
+            return -1;
+        if (diff == 0 && __atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+        if (diff > 0)
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+
+    size_t len = strnlen(text, RING_TEXT - 1);
+    memcpy(slot->text, text, len);
+    slot->text[len] = '\0';
+    slot->len = (int32_t)len;
+    slot->type = type;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * Unlike msgrcv(), a type filter only looks at the oldest message: the
+ * ring has a single order, and skipping ahead would leave holes in it.
+ */
+struct ring_slot *ring_receive(struct ring *ring, int type, uint64_t *pos)
+{
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    struct ring_slot *slot;
+
+    while (1)
+    {
+        slot = &ring->slots[tail % RING_SLOTS];
+        int64_t diff = (int64_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (tail + 1));
+
+        if (diff < 0)
+            return NULL;
+        if (diff > 0)
+        {
+            tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (type != 0 && __atomic_load_n(&slot->type, __ATOMIC_RELAXED) != type)
+            return NULL;
+        if (__atomic_compare_exchange_n(&ring->tail, &tail, tail + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+
+    *pos = tail;
+    return slot;
+}
+
+void ring_release(struct ring_slot *slot, uint64_t pos)
+{
+    __atomic_store_n(&slot->seq, pos + RING_SLOTS, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,39 @@
+#include <rng.h>
+
+/* splitmix64, to spread nearby seeds and slots over the whole state space. */
+static uint64_t mix(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+void rng_seed(struct rng *rng, uint64_t seed, int team, int slot, int id)
+{
+    uint64_t state = mix(seed);
+
+    state = mix(state ^ (uint64_t)(uint32_t)team);
+    state = mix(state ^ (uint64_t)(uint32_t)slot);
+    state = mix(state ^ (uint64_t)(uint32_t)id);
+
+    /* xorshift must never be seeded with zero. */
+    rng->state = state ? state : 0x9E3779B97F4A7C15ULL;
+}
+
+uint64_t rng_next(struct rng *rng)
+{
+    uint64_t x = rng->state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform in [0, bound) without a division (Lemire's multiply-shift). */
+uint32_t rng_below(struct rng *rng, uint32_t bound)
+{
+    return (uint32_t)(((rng_next(rng) >> 32) * (uint64_t)bound) >> 32);
+}
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <globals.h>
+#include <segment.h>
+
+static const char *backend_names[] = {"sysv", "posix", "file"};
+
+const char *backend_name(int backend)
+{
+    return backend_names[backend];
+}
+
+int parse_backend(const char *s)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (strcmp(s, backend_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static size_t round_size(size_t size)
+{
+    if (!use_hugepages)
+        return size;
+    return (size + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+}
+
+static void object_path(char *path, size_t len, int backend, const char *name)
+{
+    if (backend == BACKEND_POSIX)
+        snprintf(path, len, "/%s", name);
+    else
+        snprintf(path, len, "%s/%s", backing_dir, name);
+}
+
+static int open_object(int backend, const char *path, int flags)
+{
+    if (backend == BACKEND_POSIX)
+        return shm_open(path, flags, 0666);
+    return open(path, flags, 0666);
+}
+
+static void *sysv_create(struct segment *seg, key_t key)
+{
+    seg->id = -1;
+    if (use_hugepages)
+    {
+        seg->id = shmget(key, seg->size, IPC_CREAT | IPC_EXCL | SHM_HUGETLB | 0666);
+        if (seg->id == -1 && errno != EEXIST)
+            perror("shmget (huge pages), falling back to normal pages");
+    }
+    if (seg->id == -1 && errno != EEXIST)
+        seg->id = shmget(key, seg->size, IPC_CREAT | IPC_EXCL | 0666);
+    if (seg->id == -1)
+    {
+        if (errno == EEXIST)
+            return NULL;
+        perror("shmget (segment)");
+        exit(EXIT_FAILURE);
+    }
+
+    seg->addr = shmat(seg->id, NULL, 0);
+    if (seg->addr == (void *)-1)
+    {
+        perror("shmat (segment)");
+        exit(EXIT_FAILURE);
+    }
+    return seg->addr;
+}
+
+static void *mapped_create(struct segment *seg, const char *name)
+{
+    char path[BACKING_DIR_MAX + 64];
+    int fd;
+
+    object_path(path, sizeof(path), seg->backend, name);
+    fd = open_object(seg->backend, path, O_RDWR | O_CREAT | O_EXCL);
+    if (fd == -1)
+    {
+        if (errno == EEXIST)
+            return NULL;
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    if (ftruncate(fd, seg->size) == -1)
+    {
+        perror("ftruncate (segment)");
+        exit(EXIT_FAILURE);
+    }
+
+    seg->addr = mmap(NULL, seg->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg->addr == MAP_FAILED)
+    {
+        perror("mmap (segment)");
+        exit(EXIT_FAILURE);
+    }
+    segment_use_hugepages(seg);
+    return seg->addr;
+}
+
+void *segment_create(struct segment *seg, key_t key, const char *name, size_t size)
+{
+    seg->backend = shm_backend;
+    seg->id = -1;
+    seg->addr = NULL;
+    seg->size = round_size(size);
+    if (shm_backend == BACKEND_SYSV)
+        return sysv_create(seg, key);
+    return mapped_create(seg, name);
+}
+
+void *segment_open(struct segment *seg, key_t key, const char *name, int read_only)
+{
+    char path[BACKING_DIR_MAX + 64];
+    struct stat st;
+    int fd;
+
+    seg->backend = shm_backend;
+    seg->id = -1;
+    seg->addr = NULL;
+    if (shm_backend == BACKEND_SYSV)
+    {
+        struct shmid_ds shm_info;
+
+        seg->id = shmget(key, 0, 0);
+        if (seg->id == -1 || shmctl(seg->id, IPC_STAT, &shm_info) == -1)
+            return NULL;
+        seg->size = shm_info.shm_segsz;
+        seg->addr = shmat(seg->id, NULL, read_only ? SHM_RDONLY : 0);
+        if (seg->addr == (void *)-1)
+            seg->addr = NULL;
+        return seg->addr;
+    }
+
+    object_path(path, sizeof(path), shm_backend, name);
+    fd = open_object(shm_backend, path, read_only ? O_RDONLY : O_RDWR);
+    if (fd == -1)
+        return NULL;
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+    seg->size = st.st_size;
+    seg->addr = mmap(NULL, seg->size, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg->addr == MAP_FAILED)
+        seg->addr = NULL;
+    return seg->addr;
+}
+
+int segment_find(key_t key, const char *name)
+{
+    char path[BACKING_DIR_MAX + 64];
+    int fd;
+
+    if (shmget(key, 0, 0) != -1)
+        return shm_backend = BACKEND_SYSV;
+
+    for (int backend = BACKEND_POSIX; backend <= BACKEND_FILE; backend++)
+    {
+        object_path(path, sizeof(path), backend, name);
+        fd = open_object(backend, path, O_RDONLY);
+        if (fd != -1)
+        {
+            close(fd);
+            return shm_backend = backend;
+        }
+    }
+    return -1;
+}
+
+/* SysV huge pages are decided at creation; mappings can still be advised. */
+void segment_use_hugepages(struct segment *seg)
+{
+    if (seg->backend != BACKEND_SYSV && use_hugepages)
+        madvise(seg->addr, seg->size, MADV_HUGEPAGE);
+}
+
+int segment_attach_count(struct segment *seg)
+{
+    struct shmid_ds shm_info;
+
+    if (seg->backend != BACKEND_SYSV || shmctl(seg->id, IPC_STAT, &shm_info) == -1)
+        return -1;
+    return (int)shm_info.shm_nattch;
+}
+
+void segment_detach(struct segment *seg)
+{
+    if (seg->addr == NULL)
+        return;
+    if (seg->backend == BACKEND_SYSV)
+    {
+        if (shmdt(seg->addr) == -1)
+            perror("shmdt (segment)");
+    }
+    else if (munmap(seg->addr, seg->size) == -1)
+    {
+        perror("munmap (segment)");
+    }
+    seg->addr = NULL;
+}
+
+int segment_remove(key_t key, const char *name)
+{
+    char path[BACKING_DIR_MAX + 64];
+
+    if (shm_backend == BACKEND_SYSV)
+    {
+        int id = shmget(key, 0, 0666);
+
+        return id == -1 ? -1 : shmctl(id, IPC_RMID, NULL);
+    }
+
+    object_path(path, sizeof(path), shm_backend, name);
+    if (shm_backend == BACKEND_POSIX)
+        return shm_unlink(path);
+    return unlink(path);
+}
@@ -0,0 +1,162 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include <globals.h>
+#include <spatial.h>
+
+#define BUCKET_SIDE 8
+
+/*
+ * buckets[bucket * MAX_TEAMS + team] counts the pieces of team in the bucket.
+ * Team 0 is never on the board, so its slot holds the bucket total.
+ */
+static int *matrix = NULL;
+static int *buckets = NULL;
+static int bucket_rows;
+static int bucket_cols;
+
+static void compute_buckets(int width, int height)
+{
+    bucket_rows = (height + BUCKET_SIDE - 1) / BUCKET_SIDE;
+    bucket_cols = (width + BUCKET_SIDE - 1) / BUCKET_SIDE;
+}
+
+size_t spatial_index_size(int width, int height)
+{
+    compute_buckets(width, height);
+    return (size_t)bucket_rows * bucket_cols * MAX_TEAMS * sizeof(int);
+}
+
+void spatial_attach(int *shared_matrix, int *shared_index)
+{
+    compute_buckets(board_width, board_height);
+    matrix = shared_matrix;
+    buckets = shared_index;
+}
+
+void spatial_reset()
+{
+    memset(buckets, 0, spatial_index_size(board_width, board_height));
+}
+
+void spatial_add(int row, int col, int team, int delta)
+{
+    int *bucket = &buckets[((row / BUCKET_SIDE) * bucket_cols + col / BUCKET_SIDE) * MAX_TEAMS];
+
+    __atomic_add_fetch(&bucket[team], delta, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bucket[0], delta, __ATOMIC_RELAXED);
+}
+
+/*
+ * What a search looks for: the pieces of any team but ours, or our own
+ * pieces except the one at skip.
+ */
+struct search
+{
+    int team;
+    int ally;
+    int skip_row;
+    int skip_col;
+};
+
+static int bucket_matches(int br, int bc, const struct search *s)
+{
+    int *bucket = &buckets[(br * bucket_cols + bc) * MAX_TEAMS];
+    int ours = __atomic_load_n(&bucket[s->team], __ATOMIC_RELAXED);
+
+    if (s->ally)
+        return ours;
+    return __atomic_load_n(&bucket[0], __ATOMIC_RELAXED) - ours;
+}
+
+static int cell_matches(int r, int c, int value, const struct search *s)
+{
+    if (s->ally)
+        return value == s->team && (r != s->skip_row || c != s->skip_col);
+    return value != 0 && value != s->team;
+}
+
+/* Same tie break as a row major scan: the first cell wins. */
+static void scan_bucket(int br, int bc, int row, int col, const struct search *s, int *best, int *target_row, int *target_col)
+{
+    int bottom = (br + 1) * BUCKET_SIDE;
+    int right = (bc + 1) * BUCKET_SIDE;
+
+    if (bottom > board_height)
+        bottom = board_height;
+    if (right > board_width)
+        right = board_width;
+
+    for (int r = br * BUCKET_SIDE; r < bottom; r++)
+    {
+        for (int c = bc * BUCKET_SIDE; c < right; c++)
+        {
+            int value = __atomic_load_n(&matrix[r * board_width + c], __ATOMIC_RELAXED);
+            if (!cell_matches(r, c, value, s))
+                continue;
+
+            int distance = abs(row - r) + abs(col - c);
+            if (distance < *best || (distance == *best && (r < *target_row || (r == *target_row && c < *target_col))))
+            {
+                *best = distance;
+                *target_row = r;
+                *target_col = c;
+            }
+        }
+    }
+}
+
+/*
+ * Visits buckets in rings of growing Chebyshev distance around ours and only
+ * looks inside buckets that hold a match. Every cell of ring k + 1 is more
+ * than k * BUCKET_SIDE cells away, so once something at most that close has
+ * been found the search stops: the cost follows the distance to the target,
+ * not the board area.
+ */
+static int nearest(int row, int col, const struct search *s, int *target_row, int *target_col)
+{
+    int br = row / BUCKET_SIDE;
+    int bc = col / BUCKET_SIDE;
+    int max_ring = bucket_rows > bucket_cols ? bucket_rows : bucket_cols;
+    int best = board_width + board_height;
+
+    *target_row = -1;
+    *target_col = -1;
+
+    for (int k = 0; k < max_ring; k++)
+    {
+        for (int r = br - k; r <= br + k; r++)
+        {
+            if (r < 0 || r >= bucket_rows)
+                continue;
+
+            /* Inner rows of the ring only have their two edge buckets. */
+            int step = (r == br - k || r == br + k) ? 1 : 2 * k;
+            for (int c = bc - k; c <= bc + k; c += step > 0 ? step : 1)
+            {
+                if (c < 0 || c >= bucket_cols || bucket_matches(r, c, s) <= 0)
+                    continue;
+                scan_bucket(r, c, row, col, s, &best, target_row, target_col);
+            }
+        }
+
+        if (*target_row != -1 && best <= k * BUCKET_SIDE)
+            break;
+    }
+
+    return *target_row == -1 ? -1 : 1;
+}
+
+int spatial_nearest_enemy(int row, int col, int team, int *target_row, int *target_col)
+{
+    struct search s = {team, 0, -1, -1};
+
+    return nearest(row, col, &s, target_row, target_col);
+}
+
+int spatial_nearest_ally(int row, int col, int team, int skip_row, int skip_col, int *ally_row, int *ally_col)
+{
+    struct search s = {team, 1, skip_row, skip_col};
+
+    return nearest(row, col, &s, ally_row, ally_col);
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <globals.h>
+#include <lem_ipc.h>
+#include <stats.h>
+#include <arena.h>
+
+static const char *site_names[LOCK_SITES] = {
+    "join", "placement", "move", "capture", "render", "cleanup", "turn", "checkpoint"
+};
+
+static struct lock_stats *stats = NULL;
+static volatile sig_atomic_t stop_watching = 0;
+
+void stats_attach(struct lock_stats *shared)
+{
+    stats = shared;
+}
+
+void stats_wait(int site, uint64_t ns)
+{
+    if (stats != NULL)
+        hist_record(&stats->wait[site], ns);
+}
+
+void stats_hold(int site, uint64_t ns)
+{
+    if (stats != NULL)
+        hist_record(&stats->hold[site], ns);
+}
+
+static void handle_stats_sigint(int sig)
+{
+    (void)sig;
+    stop_watching = 1;
+}
+
+static void print_stats(const struct lock_stats *s)
+{
+    printf("%-10s %10s %10s %10s %10s %10s %10s %10s\n", "site(us)", "acquires",
+           "wait p50", "wait p99", "wait max", "hold p50", "hold p99", "hold max");
+    for (int i = 0; i < LOCK_SITES; i++)
+    {
+        printf("%-10s %10llu %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", site_names[i],
+               (unsigned long long)hist_total(&s->wait[i]),
+               hist_percentile(&s->wait[i], 0.50) / 1e3,
+               hist_percentile(&s->wait[i], 0.99) / 1e3,
+               hist_percentile(&s->wait[i], 1.0) / 1e3,
+               hist_percentile(&s->hold[i], 0.50) / 1e3,
+               hist_percentile(&s->hold[i], 0.99) / 1e3,
+               hist_percentile(&s->hold[i], 1.0) / 1e3);
+    }
+    fflush(stdout);
+}
+
+void show_stats(int watch)
+{
+    if (!arena_attach_read_only())
+    {
+        fprintf(stderr, "No game running (arena not found).\n");
+        exit(EXIT_FAILURE);
+    }
+    const struct lock_stats *s = ARENA_SECTION(struct lock_stats, stats);
+    const struct game_state *game = ARENA_SECTION(struct game_state, game);
+
+    signal(SIGINT, handle_stats_sigint);
+    print_stats(s);
+
+    /* The last player sets the process count to zero on its way out. */
+    while (watch && !stop_watching && __atomic_load_n(&game->processes, __ATOMIC_ACQUIRE) > 0)
+    {
+        sleep(1);
+        printf("\n");
+        print_stats(s);
+    }
+
+    arena_detach();
+}
@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include <ft_malloc.h>
+#include <globals.h>
+#include <lem_ipc.h>
+#include <histogram.h>
+#include <trace.h>
+
+/* Broken events shown in full by the replayer before it just counts them. */
+#define TRACE_SHOWN_ERRORS 10
+
+#define TRACE_FILE_SIZE(events) (sizeof(struct trace_header) + (size_t)(events) * sizeof(struct trace_event))
+
+static struct trace_header *trace = NULL;
+static struct trace_event *events = NULL;
+/* Kept open to grow the file. */
+static int trace_fd = -1;
+static int warned_full = 0;
+
+/* Slots [chunk_next, chunk_end) are this thread's to fill. */
+static __thread uint64_t chunk_next = 0;
+static __thread uint64_t chunk_end = 0;
+
+static const char *const event_names[] = {"none", "join", "move", "capture", "leave"};
+
+static void *map_trace(int fd, size_t size, int prot)
+{
+    void *addr = mmap(NULL, size, prot, MAP_SHARED | MAP_NORESERVE, fd, 0);
+
+    if (addr == MAP_FAILED)
+    {
+        perror("mmap (trace)");
+        exit(EXIT_FAILURE);
+    }
+    return addr;
+}
+
+static int valid_header(const struct trace_header *h)
+{
+    return h->magic == TRACE_MAGIC && h->version == TRACE_VERSION &&
+           h->event_size == sizeof(struct trace_event) && h->capacity == TRACE_EVENTS;
+}
+
+/*
+ * A trace holds one game. Under an flock, the first process of a game to
+ * open it starts it over, empty, unless it already is this game's; every
+ * other player of the game then finds the header it wrote. Files that are
+ * not traces are left alone.
+ */
+int trace_open(const char *path, uint64_t game_id)
+{
+    struct stat st;
+
+    if ((trace_fd = open(path, O_RDWR | O_CREAT, 0644)) == -1)
+    {
+        perror(path);
+        return -1;
+    }
+    if (flock(trace_fd, LOCK_EX) == -1 || fstat(trace_fd, &st) == -1)
+    {
+        perror(path);
+        trace_close();
+        return -1;
+    }
+    if (st.st_size != 0 && (size_t)st.st_size < sizeof(struct trace_header))
+    {
+        fprintf(stderr, "'%s' is not a trace file.\n", path);
+        trace_close();
+        return -1;
+    }
+
+    /* Room for every event is mapped now; only the file grows later. */
+    trace = map_trace(trace_fd, TRACE_FILE_SIZE(TRACE_EVENTS), PROT_READ | PROT_WRITE);
+    if (st.st_size != 0 && trace->magic != TRACE_MAGIC)
+    {
+        fprintf(stderr, "'%s' is not a trace file.\n", path);
+        trace_close();
+        return -1;
+    }
+    if (st.st_size == 0 || !valid_header(trace) || trace->game_id != game_id)
+    {
+        /* Dropping the pages zeroes every event of the previous game. */
+        if (ftruncate(trace_fd, 0) == -1 || ftruncate(trace_fd, TRACE_FILE_SIZE(TRACE_GROW)) == -1)
+        {
+            perror("ftruncate (trace)");
+            trace_close();
+            return -1;
+        }
+        trace->version = TRACE_VERSION;
+        trace->event_size = sizeof(struct trace_event);
+        trace->width = board_width;
+        trace->height = board_height;
+        trace->capacity = TRACE_EVENTS;
+        trace->allocated = TRACE_GROW;
+        trace->game_id = game_id;
+        trace->start_ns = monotonic_ns();
+        trace->magic = TRACE_MAGIC;
+    }
+    /* The mapping keeps the file open, so closing it would not unlock it. */
+    flock(trace_fd, LOCK_UN);
+    events = (struct trace_event *)(trace + 1);
+    return 1;
+}
+
+void trace_close()
+{
+    if (trace != NULL)
+        munmap(trace, TRACE_FILE_SIZE(TRACE_EVENTS));
+    if (trace_fd != -1)
+        close(trace_fd);
+    trace = NULL;
+    events = NULL;
+    trace_fd = -1;
+}
+
+/*
+ * Makes the file hold at least end events. posix_fallocate() only ever
+ * grows it, so processes growing it at once cannot shrink it back.
+ */
+static int grow(uint64_t end)
+{
+    uint64_t allocated = __atomic_load_n(&trace->allocated, __ATOMIC_ACQUIRE);
+
+    if (end <= allocated)
+        return 1;
+
+    uint64_t wanted = (end + TRACE_GROW - 1) / TRACE_GROW * TRACE_GROW;
+
+    if (wanted > TRACE_EVENTS)
+        wanted = TRACE_EVENTS;
+    if (posix_fallocate(trace_fd, 0, TRACE_FILE_SIZE(wanted)) != 0)
+        return -1;
+    while (allocated < wanted &&
+           !__atomic_compare_exchange_n(&trace->allocated, &allocated, wanted, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        ;
+    return 1;
+}
+
+static int reserve(uint64_t *slot)
+{
+    if (chunk_next == chunk_end)
+    {
+        uint64_t start = __atomic_fetch_add(&trace->next, TRACE_CHUNK, __ATOMIC_RELAXED);
+        uint64_t end = start + TRACE_CHUNK < TRACE_EVENTS ? start + TRACE_CHUNK : TRACE_EVENTS;
+
+        if (start >= TRACE_EVENTS || grow(end) == -1)
+            return -1;
+        chunk_next = start;
+        chunk_end = end;
+    }
+    *slot = chunk_next++;
+    return 1;
+}
+
+/* Called with the cells involved still locked, so times follow the board. */
+void trace_record(int type, int team, int other, int row, int col, int to_row, int to_col)
+{
+    uint64_t slot;
+
+    if (trace == NULL)
+        return;
+    if (reserve(&slot) == -1)
+    {
+        __atomic_add_fetch(&trace->dropped, 1, __ATOMIC_RELAXED);
+        if (!__atomic_exchange_n(&warned_full, 1, __ATOMIC_RELAXED))
+            fprintf(stderr, "Trace full or out of space: events from now on are dropped.\n");
+        return;
+    }
+
+    struct trace_event *e = &events[slot];
+
+    e->ns = monotonic_ns() - trace->start_ns;
+    e->pid = getpid();
+    e->team = team;
+    e->other = other;
+    e->row = row;
+    e->col = col;
+    e->to_row = to_row;
+    e->to_col = to_col;
+    __atomic_store_n(&e->type, type, __ATOMIC_RELEASE);
+}
+
+/* Events in time order; ties keep file order. */
+struct replay_event
+{
+    struct trace_event e;
+    uint64_t slot;
+};
+
+static int compare_events(const void *a, const void *b)
+{
+    const struct replay_event *x = a;
+    const struct replay_event *y = b;
+
+    if (x->e.ns != y->e.ns)
+        return x->e.ns < y->e.ns ? -1 : 1;
+    return x->slot < y->slot ? -1 : x->slot > y->slot;
+}
+
+struct replay_totals
+{
+    uint64_t by_type[TRACE_LEAVE + 1];
+    uint64_t joins[MAX_TEAMS];
+    uint64_t moves[MAX_TEAMS];
+    uint64_t captures[MAX_TEAMS];
+    uint64_t lost[MAX_TEAMS];
+    uint64_t broken;
+    uint64_t longest_gap;
+    uint64_t gap_end;
+};
+
+static int in_board(int row, int col)
+{
+    return row < board_height && col < board_width;
+}
+
+/*
+ * Applies one event to the board if the board agrees with it. Events that
+ * do not fit (only possible in lock-free mode, or with a torn trace) are
+ * counted and skipped.
+ */
+static int apply_event(int *board, const struct trace_event *e, struct replay_totals *t)
+{
+    int team = e->team < MAX_TEAMS ? e->team : 0;
+    int *cell = in_board(e->row, e->col) ? &board[e->row * board_width + e->col] : NULL;
+
+    switch (e->type)
+    {
+    case TRACE_JOIN:
+        if (cell == NULL || *cell != 0)
+            return -1;
+        *cell = team;
+        t->joins[team]++;
+        return 1;
+    case TRACE_MOVE:
+        if (cell == NULL || *cell != team || !in_board(e->to_row, e->to_col) || board[e->to_row * board_width + e->to_col] != 0)
+            return -1;
+        *cell = 0;
+        board[e->to_row * board_width + e->to_col] = team;
+        t->moves[team]++;
+        return 1;
+    case TRACE_CAPTURE:
+        if (cell == NULL || e->other >= MAX_TEAMS || *cell != e->other)
+            return -1;
+        *cell = 0;
+        t->captures[team]++;
+        t->lost[e->other]++;
+        return 1;
+    case TRACE_LEAVE:
+        if (cell == NULL || *cell != team)
+            return -1;
+        *cell = 0;
+        return 1;
+    }
+    return -1;
+}
+
+static void print_totals(const struct replay_totals *t, const int *board, uint64_t span)
+{
+    int pieces[MAX_TEAMS] = {0};
+    int teams_left = 0;
+    int last_team = 0;
+
+    for (int i = 0; i < board_width * board_height; i++)
+    {
+        if (board[i] > 0 && board[i] < MAX_TEAMS)
+            pieces[board[i]]++;
+    }
+
+    printf("%llu joins, %llu moves, %llu captures, %llu leaves over %.3f s.\n",
+           (unsigned long long)t->by_type[TRACE_JOIN], (unsigned long long)t->by_type[TRACE_MOVE],
+           (unsigned long long)t->by_type[TRACE_CAPTURE], (unsigned long long)t->by_type[TRACE_LEAVE], span / 1e9);
+    for (int team = 1; team < MAX_TEAMS; team++)
+    {
+        if (t->joins[team] == 0)
+            continue;
+        printf("Team %d: %llu pieces joined, %llu moves, %llu captures made, %llu pieces lost, %d left.\n", team,
+               (unsigned long long)t->joins[team], (unsigned long long)t->moves[team],
+               (unsigned long long)t->captures[team], (unsigned long long)t->lost[team], pieces[team]);
+        if (pieces[team] > 0)
+        {
+            teams_left++;
+            last_team = team;
+        }
+    }
+    if (teams_left == 1)
+        printf("Team %d won.\n", last_team);
+    printf("Longest quiet stretch: %.3f ms, ending at %.3f s.\n", t->longest_gap / 1e6, t->gap_end / 1e9);
+    if (t->broken != 0)
+        printf("%llu events did not fit the board and were skipped.\n", (unsigned long long)t->broken);
+}
+
+void trace_replay(const char *path, int fps)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+
+    if (fd == -1)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct trace_header))
+    {
+        fprintf(stderr, "'%s' is not a trace file.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    const struct trace_header *h = map_trace(fd, st.st_size, PROT_READ);
+    const struct trace_event *file_events = (const struct trace_event *)(h + 1);
+
+    close(fd);
+    if (!valid_header(h) || h->width == 0 || h->width > MAX_BOARD_SIDE || h->height == 0 || h->height > MAX_BOARD_SIDE)
+    {
+        fprintf(stderr, "'%s' is not a trace file of this version.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    board_width = h->width;
+    board_height = h->height;
+
+    uint64_t in_file = (st.st_size - sizeof(struct trace_header)) / sizeof(struct trace_event);
+    uint64_t used = h->next < in_file ? h->next : in_file;
+    struct replay_event *list = malloc((used ? used : 1) * sizeof(struct replay_event));
+    uint64_t count = 0;
+
+    for (uint64_t i = 0; i < used; i++)
+    {
+        if (file_events[i].type == TRACE_NONE || file_events[i].type > TRACE_LEAVE)
+            continue;
+        list[count].e = file_events[i];
+        list[count].slot = i;
+        count++;
+    }
+    qsort(list, count, sizeof(struct replay_event), compare_events);
+
+    printf("Replaying %llu events on a %dx%d board.\n", (unsigned long long)count, board_width, board_height);
+    if (h->dropped != 0)
+        printf("The trace filled up: %llu events were not recorded.\n", (unsigned long long)h->dropped);
+
+    int *board = malloc((size_t)board_width * board_height * sizeof(int));
+    struct replay_totals totals;
+    uint64_t previous = 0;
+
+    memset(board, 0, (size_t)board_width * board_height * sizeof(int));
+    memset(&totals, 0, sizeof(totals));
+    for (uint64_t i = 0; i < count; i++)
+    {
+        const struct trace_event *e = &list[i].e;
+
+        if (e->ns - previous > totals.longest_gap)
+        {
+            totals.longest_gap = e->ns - previous;
+            totals.gap_end = e->ns;
+        }
+        previous = e->ns;
+        totals.by_type[e->type]++;
+
+        if (apply_event(board, e, &totals) == -1)
+        {
+            if (totals.broken++ < TRACE_SHOWN_ERRORS)
+                printf("%.6f s: %s by player %d of Team %d at [%d, %d] does not fit the board.\n", e->ns / 1e9,
+                       event_names[e->type], e->pid, e->team, e->row, e->col);
+            continue;
+        }
+        if (render_board)
+        {
+            print_matrix(board);
+            usleep(1000000 / fps);
+        }
+    }
+
+    print_totals(&totals, board, count ? list[count - 1].e.ns - list[0].e.ns : 0);
+    free(board);
+    free(list);
+    munmap((void *)h, st.st_size);
+}
@@ -0,0 +1,144 @@
+#include <unistd.h>
+
+#include <globals.h>
+#include <lem_ipc.h>
+#include <locks.h>
+#include <futex.h>
+#include <stats.h>
+#include <turns.h>
+
+/* How long a waiter trusts the holder before checking it is still alive. */
+#define TURN_CHECK_MS 100
+
+/*
+ * The token is game->current_player_pid itself, 0 when nobody holds it.
+ * Only the holder moves it on, with a CAS, so a waiter that finds the
+ * holder dead can take over passing it without racing a live holder.
+ * Every roster slot has its own futex word, bumped when the token is
+ * handed to that slot, so a handoff wakes exactly one process.
+ */
+static struct game_state *game = NULL;
+static int *roster = NULL;
+static int my_team = -1;
+static int my_slot = -1;
+static int my_pid = 0;
+static uint64_t held_since;
+
+int turns_enabled()
+{
+    return game != NULL && lock_mode == LOCK_GLOBAL;
+}
+
+void turns_attach(int team, int slot)
+{
+    game = ARENA_SECTION(struct game_state, game);
+    roster = ARENA_SECTION(int, roster);
+    my_team = team;
+    my_slot = slot;
+    my_pid = getpid();
+}
+
+/*
+ * Next team after from_team with anybody in it (from_team itself last),
+ * and in that team the next slot after its cursor. 0 if the roster is
+ * empty.
+ */
+static int next_player(int from_team, int *next_team, int *next_slot)
+{
+    for (int i = 1; i <= MAX_TEAMS; i++)
+    {
+        int t = (from_team + i) % MAX_TEAMS;
+        int cursor = __atomic_load_n(&game->turn_cursor[t], __ATOMIC_RELAXED);
+
+        for (int j = 0; j < MAX_PROCESSES; j++)
+        {
+            int s = (cursor + j) % MAX_PROCESSES;
+            int pid = __atomic_load_n(&roster[t * MAX_PROCESSES + s], __ATOMIC_ACQUIRE);
+
+            if (pid == 0)
+                continue;
+            __atomic_store_n(&game->turn_cursor[t], (s + 1) % MAX_PROCESSES, __ATOMIC_RELAXED);
+            *next_team = t;
+            *next_slot = s;
+            return pid;
+        }
+    }
+    return 0;
+}
+
+static void pass_from(int holder, int holder_team)
+{
+    int next_team = 0;
+    int next_slot = 0;
+    int next = next_player(holder_team, &next_team, &next_slot);
+
+    if (!__atomic_compare_exchange_n(&game->current_player_pid, &holder, next, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return;
+    if (next == 0 || next == my_pid)
+        return;
+
+    uint32_t *word = &game->turn_wake[next_team][next_slot];
+    __atomic_add_fetch(word, 1, __ATOMIC_RELEASE);
+    futex_wake(word, 1);
+}
+
+/*
+ * A holder killed without running cleanup() would keep the turn forever:
+ * the reaper drops it from the roster and forfeits its turn.
+ */
+static void check_holder(int holder)
+{
+    if (holder == 0 || holder == my_pid || !player_is_dead(holder))
+        return;
+    reap_dead_players();
+}
+
+void turn_forfeit(int pid, int team)
+{
+    if (turns_enabled())
+        pass_from(pid, team);
+}
+
+void turn_acquire()
+{
+    uint32_t *word;
+    uint64_t start;
+
+    if (!turns_enabled())
+        return;
+
+    word = &game->turn_wake[my_team][my_slot];
+    start = monotonic_ns();
+    while (1)
+    {
+        /* Read before the token, so a handoff in between fails the wait. */
+        uint32_t seen = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+        int holder = __atomic_load_n(&game->current_player_pid, __ATOMIC_ACQUIRE);
+
+        if (holder == my_pid)
+            break;
+        if (holder == 0 && __atomic_compare_exchange_n(&game->current_player_pid, &holder, my_pid, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+        if (futex_wait(word, seen, TURN_CHECK_MS) == -1)
+            check_holder(holder);
+    }
+
+    game->current_team = my_team;
+    held_since = monotonic_ns();
+    stats_wait(LOCK_SITE_TURN, held_since - start);
+}
+
+void turn_pass()
+{
+    if (!turns_enabled() || __atomic_load_n(&game->current_player_pid, __ATOMIC_ACQUIRE) != my_pid)
+        return;
+
+    stats_hold(LOCK_SITE_TURN, monotonic_ns() - held_since);
+    pass_from(my_pid, my_team);
+}
+
+void turn_leave()
+{
+    turn_pass();
+    game = NULL;
+}